@@ -1,18 +1,29 @@
 #include <stdlib.h>
+#include <string.h>
 #include "ai.h"
 #include "exit.h"
+#include "pool.h"
 #include "gold.h"
 #include "guard.h"
 #include "level.h"
 #include "phys.h"
+#include "rng.h"
 #include "tile.h"
+#include "timer.h"
 
 // TODO: Should we join ai.c and guard.c.
 
-// TODO: Looks like this is the max number of guards possible.
-//       Update another define.
+// Rows of move_policy, guards' moves of more guards are computed, see
+// ai_moves().
 #define MP_NGUARDS 12
 #define MP_NMOVES 6
+// Max number of guards' moves per tick, see ai_moves().
+#define MP_NMOVES_MAX ((2 * MAX_GUARDS + 2) / MP_NMOVES + 1)
+// Fewer guards' moves per tick are made one by one even with a pool.
+// Waking workers up and waiting for them takes about 5us per tick, while a
+// guard's direction is looked for in about 0.5us, so with two or more CPUs
+// the pool pays off from about 16 moves (48 guards), see lr-sim -j.
+#define AI_PARALLEL_MOVES 16
 
 // Algorithm traces possible routes and calculate rating (score) for every
 // route. Lower rating is better.
@@ -22,7 +33,14 @@
 // below him. To make it works we use this trick with rating offset.
 #define RATING_BASE_BELLOW 200
 #define RATING_BASE_ABOVE 100
-
+// Memoized route ends, see ai_scan_down().
+#define AI_NOROUTE -1
+#define AI_UNKNOWN -2
+// Most routes a guard's scan traces: down and up from every map column.
+#define AI_LOG_MAX (2 * MAP_MAX_WIDTH)
+
+// Number of guards moved on every tick of the cycle of MP_NMOVES ticks
+// by the number of guards on the map as the original game does it.
 static int move_policy[MP_NGUARDS][MP_NMOVES] = {
     {0, 0, 0, 0, 0, 0},
     {0, 1, 1, 0, 1, 1},
@@ -38,6 +56,44 @@ static int move_policy[MP_NGUARDS][MP_NMOVES] = {
     {4, 4, 4, 4, 4, 4},
 };
 
+// Return number of guards moved on the tick i of the cycle of MP_NMOVES
+// ticks. More guards than move_policy has rows for continue its rule: n
+// guards make 2n + 2 moves per cycle spread evenly over the ticks, the two
+// or four extra moves go to the ticks 2 and 5, then 1 and 4. So every
+// guard moves about once per three ticks however many of them there are.
+static int ai_moves(int nguards, int i)
+{
+    if (nguards < MP_NGUARDS) {
+        return move_policy[nguards][i];
+    }
+
+    int n = 2 * nguards + 2;
+    int moves = n / MP_NMOVES;
+    int extra = n % MP_NMOVES;
+    if (extra >= 2 && (i == 2 || i == 5)) {
+        moves++;
+    }
+    if (extra >= 4 && (i == 1 || i == 4)) {
+        moves++;
+    }
+
+    return moves;
+}
+
+// End of the route traced from x:y, see ai_scan_down().
+struct ai_route {
+    uint8_t x;
+    uint8_t y;
+    bool up;
+    int8_t end;
+};
+
+// Routes traced while the game is only read, see ai_memo().
+struct ai_log {
+    int n;
+    struct ai_route routes[AI_LOG_MAX];
+};
+
 // Direction to move the guard to.
 enum dir {
     DIR_DOWN,
@@ -48,44 +104,52 @@ enum dir {
     DIR_UP,
 };
 
-// Return guard at x:y coordinate if there is any.
-static struct guard *guard_at_point(struct game *g, int x, int y)
+// Rows y of the memoized routes, see ai_scan_down().
+static int8_t *ai_down_row(struct game *g, int y)
 {
-    for (int i = 0; i < g->nguards; i++) {
-        if (g->guards[i]->x == x && g->guards[i]->y == y) {
-            return g->guards[i];
-        }
-    }
+    return (int8_t *) game_array(g, g->ai_down) + y * g->map.w;
+}
+
+static int8_t *ai_up_row(struct game *g, int y)
+{
+    return (int8_t *) game_array(g, g->ai_up) + y * g->map.w;
+}
 
-    return NULL;
+// Row y of the flow field, see ai_flow_build().
+static uint8_t *ai_flow_row(struct game *g, int y)
+{
+    return (uint8_t *) game_array(g, g->ai_flow) + y * g->map.w;
 }
 
 // Return random X coordinate to reborn guard at.
-static int ai_rand_rebornx()
+// Columns are shuffled once and returned one by one, so every column is tried
+// before any of them repeats.
+static int ai_rand_rebornx(struct game *game)
 {
-    static int row[MAP_WIDTH - 1];
-    static int idx = MAP_WIDTH;
+    int *row = game_array(game, game->ai_rebornx);
+
+    int w = game->map.w;
 
-    if (idx >= MAP_WIDTH) {
-        for (int i = 0; i < MAP_WIDTH; i++) {
+    if (game->ai_irebornx >= w) {
+        for (int i = 0; i < w; i++) {
             row[i] = i;
         }
-        for (int i = 0; i < MAP_WIDTH; i++) {
-            int j = (int) random() % MAP_WIDTH;
+        for (int i = 0; i < w; i++) {
+            int j = rng_next(&game->rng) % w;
 
             int t = row[i];
             row[i] = row[j];
             row[j] = t;
         }
-        idx = 0;
+        game->ai_irebornx = 0;
     }
 
-    return row[idx++];
+    return row[game->ai_irebornx++];
 }
 
-static int ai_rand_goldholds()
+static int ai_rand_goldholds(struct game *game)
 {
-    return (random() % 26) + 11; // 11..36
+    return (rng_next(&game->rng) % 26) + 11; // 11..36
 }
 
 // Try to drop gold if it is time.
@@ -99,14 +163,14 @@ static void ai_drop_gold(struct game *game, struct guard *guard)
     if (guard->goldholds < 0) {
         guard->goldholds++;
     } else if (guard->goldholds == 0
-        && guard->gold != NULL
+        && guard->gold != -1
         && is_tile(game, x, y, MAP_TILE_EMPTY)
-        && ((y == MAP_HEIGHT - 1)
+        && ((y == game->map.h - 1)
             || (is_tile(game, x, y + 1, MAP_TILE_BRICK)
                 || is_tile(game, x, y + 1, MAP_TILE_SOLID)
                 || is_tile(game, x, y + 1, MAP_TILE_LADDER)))) {
-        gold_drop(guard->gold, x, y);
-        guard->gold = NULL;
+        gold_drop(game, guard->gold, x, y);
+        guard->gold = -1;
         // Set gold holding counter to -1 to prevent picking up the gold we have
         // just dropped before moving to the next tile.
         guard->goldholds = -1;
@@ -118,19 +182,19 @@ static void ai_drop_gold(struct game *game, struct guard *guard)
 // Drop gold when trapped. Discard gold if it is not possible to drp the gold.
 static void ai_drop_gold_trapped(struct game *game, struct guard *guard)
 {
-    if (guard->gold == NULL) {
+    if (guard->gold == -1) {
         return;
     }
 
     int x = guard->x;
     int y = guard->y;
     if (is_tile(game, x, y - 1, MAP_TILE_EMPTY)) {
-        gold_drop(guard->gold, x, y - 1);
+        gold_drop(game, guard->gold, x, y - 1);
     } else {
         game_discard_gold(game, guard->gold);
     }
 
-    guard->gold = NULL;
+    guard->gold = -1;
     // Set goldholds small enough to prevent guard from picking up the gold back
     // he just dropped.
     guard->goldholds = -2;
@@ -139,8 +203,11 @@ static void ai_drop_gold_trapped(struct game *game, struct guard *guard)
 // Return true if tested map tile acts like a hole dug by the runner.
 static bool ai_hole(struct game *g, int x, int y)
 {
-    return g->map[y][x]->curt == MAP_TILE_EMPTY
-        && g->map[y][x]->baset == MAP_TILE_BRICK;
+    if (x < 0 || x >= g->map.w || y < 0 || y >= g->map.h) {
+        return false;
+    }
+
+    return map_boards(g, y)[MAP_BOARD_HOLE] >> x & 1;
 }
 
 // Check if tile at x:y coordinates has requested type and ignore holes dug
@@ -150,7 +217,13 @@ static bool ai_hole(struct game *g, int x, int y)
 bool is_tilenh(struct game *game, int x, int y, enum map_tile_t t)
 {
     if (t == MAP_TILE_BRICK) {
-        return is_tile(game, x, y, t) || ai_hole(game, x, y);
+        if (x < 0 || x >= game->map.w || y < 0 || y >= game->map.h) {
+            return false;
+        }
+        uint64_t *b = map_boards(game, y);
+        uint64_t row = b[MAP_BOARD_BRICK] | b[MAP_BOARD_HOLE];
+
+        return row >> x & 1;
     }
 
     return is_tile(game, x, y, t);
@@ -164,12 +237,37 @@ static bool ai_looking_right(enum guard_state s)
         || s == GSTATE_RIGHT;
 }
 
+// Return mask of map columns from..to inclusive.
+static uint64_t ai_span(int from, int to)
+{
+    if (from > to) {
+        return 0;
+    }
+
+    // Shift in two steps, shifting by 64 is undefined.
+    return ((uint64_t) 1 << to << 1) - ((uint64_t) 1 << from);
+}
+
+// Return the nearest column to the left or right of x which bit is set
+// in mask m of the map w columns wide. Return -1 or w if there is no such
+// column.
+static int ai_nearest(uint64_t m, int w, int x, bool left)
+{
+    if (left) {
+        m &= ai_span(0, x - 1);
+        return m == 0 ? -1 : 63 - __builtin_clzll(m);
+    }
+
+    m &= ai_span(x + 1, w - 1);
+    return m == 0 ? w : __builtin_ctzll(m);
+}
+
 // If guard and the runner on the same level (map row) guard moves
 // directly toward the runner.
 static enum dir ai_scan_level(struct game *game, struct guard *guard)
 {
-    int rx = game->runner->x;
-    int ry = game->runner->y;
+    int rx = game->runner.x;
+    int ry = game->runner.y;
     int gx = guard->x;
     int gy = guard->y;
 
@@ -177,68 +275,50 @@ static enum dir ai_scan_level(struct game *game, struct guard *guard)
         return DIR_NONE;
     }
 
-    while (gx != rx) {
-        enum map_tile_t lvl = game->map[gy][gx]->baset;
-        enum map_tile_t nextlvl;
-        if (gy < MAP_HEIGHT) {
-            nextlvl = game->map[gy + 1][gx]->baset;
-        } else {
-            nextlvl = MAP_TILE_SOLID;
-        }
-
-        // Check if we can walk on the next level or use ladder or rope on
-        // the current level to avoid falling.
-        //
-        // TODO: Handle also situations when there is a hole with a guard
-        //       trapped in that hole. In this case we can move on his head.
-        //       Check level 43.
-        //
-        // TODO: Check nextlvl == MAP_TILE_ROPE for the level 92?
-        if (lvl == MAP_TILE_LADDER || lvl == MAP_TILE_ROPE
-            || nextlvl == MAP_TILE_SOLID || nextlvl == MAP_TILE_LADDER
-            || nextlvl == MAP_TILE_BRICK) {
-            if (gx < rx) {
-                gx++;
-            } else {
-                gx--;
-            }
-        } else {
-            break;
-        }
+    // Check if we can walk on the next level or use ladder or rope on the
+    // current level to avoid falling for every column on the way to the
+    // runner, see ai_init().
+    //
+    // TODO: Handle also situations when there is a hole with a guard
+    //       trapped in that hole. In this case we can move on his head.
+    //       Check level 43.
+    //
+    // TODO: Check nextlvl == MAP_TILE_ROPE for the level 92?
+    uint64_t path = gx < rx ? ai_span(gx, rx - 1) : ai_span(rx + 1, gx);
+    uint64_t *walk = game_array(game, game->ai_walk);
+    if ((path & ~walk[gy]) != 0) {
+        // Route tracing for the current level has not succeeded,
+        // try other directions.
+        return DIR_NONE;
     }
 
-    if (gx == rx) {
-        if (guard->x < rx) {
+    if (gx < rx) {
+        return DIR_RIGHT;
+    } else if (gx > rx) {
+        return DIR_LEFT;
+    } else {
+        if (guard->tx < game->runner.tx) {
             return DIR_RIGHT;
-        } else if (guard->x > rx) {
-            return DIR_LEFT;
         } else {
-            if (guard->tx < game->runner->tx) {
-                return DIR_RIGHT;
-            } else {
-                return DIR_LEFT;
-            }
+            return DIR_LEFT;
         }
     }
-
-    // Route tracing for the current level has not succeeded,
-    // try other directions.
-    return DIR_NONE;
 }
 
-// Scan downward direction.
-// See also ai_scan_up() implementation.
-static int ai_scan_down(struct game *game, int x, int y, int startx)
+// Trace downward direction and return the row the route ends at,
+// AI_NOROUTE if there is no route.
+// See also ai_trace_up() implementation.
+static int ai_trace_down(struct game *game, int x, int y)
 {
     // Return "no route" if cannot move down.
-    if (y < MAP_HEIGHT - 1
+    if (y < game->map.h - 1
         && (is_tilenh(game, x, y + 1, MAP_TILE_BRICK)
             || is_tilenh(game, x, y + 1, MAP_TILE_SOLID))) {
-        return RATING_MAX;
+        return AI_NOROUTE;
     }
 
     // Until we haven't reached the ground.
-    while (y < MAP_HEIGHT && !is_tilenh(game, x, y + 1, MAP_TILE_BRICK)
+    while (y < game->map.h && !is_tilenh(game, x, y + 1, MAP_TILE_BRICK)
         && !is_tilenh(game, x, y + 1, MAP_TILE_SOLID)) {
         // Try to trace left and right if we can (not in a freefall mode).
         if (!is_tilenh(game, x, y, MAP_TILE_EMPTY)) {
@@ -254,18 +334,18 @@ static int ai_scan_down(struct game *game, int x, int y, int startx)
                     || is_tilenh(game, x - 1, y, MAP_TILE_ROPE)) {
                     // No need to keep moving down if we are already
                     // below the runner.
-                    if (y >= game->runner->y) {
+                    if (y >= game->runner.y) {
                         break;
                     }
                 }
             }
             // The same check for right.
-            if (x < MAP_WIDTH - 1) {
+            if (x < game->map.w - 1) {
                 if (is_tilenh(game, x + 1, y + 1, MAP_TILE_BRICK)
                     || is_tilenh(game, x + 1, y + 1, MAP_TILE_SOLID)
                     || is_tilenh(game, x + 1, y + 1, MAP_TILE_LADDER)
                     || is_tilenh(game, x + 1, y, MAP_TILE_ROPE)) {
-                    if (y >= game->runner->y) {
+                    if (y >= game->runner.y) {
                         break;
                     }
                 }
@@ -274,23 +354,17 @@ static int ai_scan_down(struct game *game, int x, int y, int startx)
         y++;
     }
 
-    if (y == game->runner->y) {
-        return abs(startx - x);
-    } else if (y > game->runner->y) {
-        return RATING_BASE_BELLOW + (y - game->runner->y);
-    } else {
-        return RATING_BASE_ABOVE + (game->runner->y - y);
-    }
+    return y;
 }
 
-// Scan upward direction.
+// Trace upward direction.
 // Our main goal here is to move above the runner. The first level above
 // the runner we can reach going up wins.
-static int ai_scan_up(struct game *game, int x, int y, int startx)
+static int ai_trace_up(struct game *game, int x, int y)
 {
     // We cannot move up without ladder for sure.
     if (!is_tilenh(game, x, y, MAP_TILE_LADDER)) {
-        return RATING_MAX;
+        return AI_NOROUTE;
     }
 
     while (y > 0 && is_tilenh(game, x, y, MAP_TILE_LADDER)) {
@@ -306,31 +380,95 @@ static int ai_scan_up(struct game *game, int x, int y, int startx)
                 || is_tilenh(game, x - 1, y + 1, MAP_TILE_LADDER)
                 || is_tilenh(game, x - 1, y, MAP_TILE_ROPE)) {
                 // No need to keep moving up if we are already above the runner.
-                if (y <= game->runner->y) {
+                if (y <= game->runner.y) {
                     break;
                 }
             }
         }
         // Perform the same logic for the right edge of the ladder.
-        if (x < MAP_WIDTH) {
+        if (x < game->map.w - 1) {
             if (is_tilenh(game, x + 1, y + 1, MAP_TILE_BRICK)
                 || is_tilenh(game, x + 1, y + 1, MAP_TILE_SOLID)
                 || is_tilenh(game, x + 1, y + 1, MAP_TILE_LADDER)
                 || is_tilenh(game, x + 1, y, MAP_TILE_ROPE)) {
-                if (y <= game->runner->y) {
+                if (y <= game->runner.y) {
                     break;
                 }
             }
         }
     }
 
-    if (y == game->runner->y) {
+    return y;
+}
+
+// Return rating of the route from the column startx which ends at x:y.
+static int ai_rating(struct game *game, int x, int y, int startx)
+{
+    if (y == AI_NOROUTE) {
+        return RATING_MAX;
+    } else if (y == game->runner.y) {
         return abs(startx - x);
-    } else if (y > game->runner->y) {
-        return RATING_BASE_BELLOW + (y - game->runner->y);
+    } else if (y > game->runner.y) {
+        return RATING_BASE_BELLOW + (y - game->runner.y);
     } else {
-        return RATING_BASE_ABOVE + (game->runner->y - y);
+        return RATING_BASE_ABOVE + (game->runner.y - y);
+    }
+}
+
+// Forget memoized routes if the map or the runner's row have changed since
+// they were traced. Routes depend on nothing else.
+static void ai_scan_validate(struct game *game)
+{
+    if (game->ai_scanver != game->map.version
+        || game->ai_scanry != game->runner.y) {
+        size_t size = (size_t) game->map.w * game->map.h;
+        memset(game_array(game, game->ai_down), AI_UNKNOWN, size);
+        memset(game_array(game, game->ai_up), AI_UNKNOWN, size);
+        game->ai_scanver = game->map.version;
+        game->ai_scanry = game->runner.y;
+    }
+}
+
+// Memoize the end of the route traced from x:y, or add it to the log to
+// be memoized later if the log is not NULL.
+static void ai_memo(struct game *game, struct ai_log *log, int x, int y,
+    bool up, int end)
+{
+    if (log == NULL) {
+        if (up) {
+            ai_up_row(game, y)[x] = end;
+        } else {
+            ai_down_row(game, y)[x] = end;
+        }
+    } else if (log->n < AI_LOG_MAX) {
+        log->routes[log->n++] = (struct ai_route) {x, y, up, end};
+    }
+}
+
+// Scan downward direction.
+static int ai_scan_down(struct game *game, int x, int y, int startx,
+    struct ai_log *log)
+{
+    int end = ai_down_row(game, y)[x];
+    if (end == AI_UNKNOWN) {
+        end = ai_trace_down(game, x, y);
+        ai_memo(game, log, x, y, false, end);
+    }
+
+    return ai_rating(game, x, end, startx);
+}
+
+// Scan upward direction.
+static int ai_scan_up(struct game *game, int x, int y, int startx,
+    struct ai_log *log)
+{
+    int end = ai_up_row(game, y)[x];
+    if (end == AI_UNKNOWN) {
+        end = ai_trace_up(game, x, y);
+        ai_memo(game, log, x, y, true, end);
     }
+
+    return ai_rating(game, x, end, startx);
 }
 
 // Scan horizontally right or left.
@@ -338,61 +476,52 @@ static int ai_scan_up(struct game *game, int x, int y, int startx)
 // can perform left or right depends on the `left` flag. Up and down branches
 // are ranged by rating, more distant route wins between two routes with the
 // same rating.
-static int ai_scan_horizontal(struct game *game, int x, int y, bool left)
+static int ai_scan_horizontal(struct game *game, int x, int y, bool left,
+    struct ai_log *log)
 {
+    uint64_t *b = map_boards(game, y);
+    int mw = game->map.w;
     int rating = RATING_MAX;
     int startx = x;
-    int dx = left ? -1 : 1;
 
-    for (;;) {
-        // Check if we have reached edge of the screen.
-        if (left && x == 0) {
-            break;
-        } else if (!left && x == MAP_WIDTH - 1) {
-            break;
-        }
-
-        if (is_tilenh(game, x + dx, y, MAP_TILE_BRICK)
-            || is_tilenh(game, x + dx, y, MAP_TILE_SOLID)) {
-            // We have reached a wall.
-            break;
-        }
-
-        // Can climb left despite what is under the feet.
-        bool climb = is_tilenh(game, x + dx, y, MAP_TILE_LADDER)
-            || is_tilenh(game, x + dx, y, MAP_TILE_ROPE);
-        // Can walk over the solid ground.
-        bool walk = (y == MAP_HEIGHT - 1)
-            || (is_tilenh(game, x + dx, y + 1, MAP_TILE_BRICK)
-                || is_tilenh(game, x + dx, y + 1, MAP_TILE_SOLID)
-                || is_tilenh(game, x + dx, y + 1, MAP_TILE_LADDER));
-
-        x += dx;
-
-        // Usually of the two routes with the same rating the first traced wins
-        // but for right and left tracing original code uses another strategy.
-        // It traces starting from the farthest point and moves to the runner.
-        // Since I start from the runner and move left we need this rating
-        // comparison inversion.
-        // Again, I'm not this is really matters because after runner moves
-        // using this route it will be recalculated and up/down lookup goes
-        // first. As a result, probably, this can be simplified.
-        int r = ai_scan_down(game, x, y, startx);
-        int q = ai_scan_up(game, x, y, startx);
+    // Walls and holes dug by the runner.
+    uint64_t wall = b[MAP_BOARD_BRICK] | b[MAP_BOARD_HOLE]
+        | b[MAP_BOARD_SOLID];
+    // Can climb left despite what is under the feet.
+    uint64_t climb = b[MAP_BOARD_LADDER] | b[MAP_BOARD_ROPE];
+    // Can walk over the solid ground.
+    uint64_t walk = ai_span(0, mw - 1);
+    if (y < game->map.h - 1) {
+        uint64_t *n = map_boards(game, y + 1);
+        walk = n[MAP_BOARD_BRICK] | n[MAP_BOARD_HOLE] | n[MAP_BOARD_SOLID]
+            | n[MAP_BOARD_LADDER];
+    }
+
+    // Route goes until the wall or the edge of the screen, or until the
+    // first tile the guard falls down from. That tile is scanned too.
+    int w = ai_nearest(wall, mw, x, left);
+    int f = ai_nearest(~(climb | walk), mw, x, left);
+    int end;
+    if (left) {
+        end = w + 1 > f ? w + 1 : f;
+    } else {
+        end = w - 1 < f ? w - 1 : f;
+    }
+
+    // Usually of the two routes with the same rating the first traced wins
+    // but for right and left tracing original code uses another strategy.
+    // It traces starting from the farthest point and moves to the runner.
+    // Since only the best rating is returned the order does not matter here.
+    int dx = left ? -1 : 1;
+    for (x += dx; left ? x >= end : x <= end; x += dx) {
+        int r = ai_scan_down(game, x, y, startx, log);
+        int q = ai_scan_up(game, x, y, startx, log);
         if (q < r) {
             r = q;
         }
         if (r <= rating) {
             rating = r;
         }
-
-        if (!climb && !walk) {
-            // Falling down.
-            // For me it looks like this complex check be replaced with
-            // a simple falling down check. Strange that the original code
-            // doesn't do that. Am I missing something?
-            break;
-        }
     }
 
     return rating;
@@ -412,7 +541,7 @@ static bool ai_falling(struct game *game, struct guard *guard)
     }
 
     if (ty < 0
-        || (y < MAP_HEIGHT - 1
+        || (y < game->map.h - 1
             && !is_tile(game, x, y + 1, MAP_TILE_BRICK)
             && !is_tile(game, x, y + 1, MAP_TILE_SOLID)
             && !is_tile(game, x, y + 1, MAP_TILE_LADDER)
@@ -445,7 +574,11 @@ static bool ai_falling(struct game *game, struct guard *guard)
 //  * Trace left path: scan down and up for every step we can perform
 //    moving left.
 //  * Trace right path: the same logic as tracing left actually.
-static enum dir ai_scan(struct game *game, struct guard *guard)
+//
+// Traced routes are memoized in the game, or added to the log if it is not
+// NULL, see ai_memo().
+static enum dir ai_scan(struct game *game, struct guard *guard,
+    struct ai_log *log)
 {
     // Avoid falling back to the hole we have just climbed out from by
     // disabling all movement or falling down.
@@ -467,23 +600,23 @@ static enum dir ai_scan(struct game *game, struct guard *guard)
     int score = RATING_MAX;
     int s;
     if (!no_down) {
-        s = ai_scan_down(game, guard->x, guard->y, guard->x);
+        s = ai_scan_down(game, guard->x, guard->y, guard->x, log);
         if (s < score) {
             score = s;
             d = DIR_DOWN;
         }
     }
-    s = ai_scan_up(game, guard->x, guard->y, guard->x);
+    s = ai_scan_up(game, guard->x, guard->y, guard->x, log);
     if (s < score) {
         score = s;
         d = DIR_UP;
     }
-    s = ai_scan_horizontal(game, guard->x, guard->y, true);
+    s = ai_scan_horizontal(game, guard->x, guard->y, true, log);
     if (s < score) {
         score = s;
         d = DIR_LEFT;
     }
-    s = ai_scan_horizontal(game, guard->x, guard->y, false);
+    s = ai_scan_horizontal(game, guard->x, guard->y, false, log);
     if (s < score) {
         score = s;
         d = DIR_RIGHT;
@@ -492,6 +625,157 @@ static enum dir ai_scan(struct game *game, struct guard *guard)
     return d;
 }
 
+// Build flow field: breadth-first search from the runner's tile backward
+// over guards' moves. Every reached tile stores the first step of the
+// shortest route to the runner, unreachable tiles and the runner's tile
+// store DIR_NONE. Of equally short routes the first step goes first in the
+// order of enum dir.
+//
+// Search goes a whole map row at a time over the bit boards. Guards move
+// by the rules of ai_move_guard(): a guard nothing holds only falls down,
+// otherwise he walks and climbs into empty, ladder and rope tiles, goes up
+// only from a ladder and avoids holes dug by the runner as the route scan
+// does.
+static void ai_flow_build(struct game *game)
+{
+    int w = game->map.w;
+    int h = game->map.h;
+    int rx = game->runner.x;
+    int ry = game->runner.y;
+    // Tiles guard can be in, tiles which hold him and ladders.
+    uint64_t stand[MAP_MAX_HEIGHT];
+    uint64_t held[MAP_MAX_HEIGHT];
+    uint64_t ladder[MAP_MAX_HEIGHT];
+    // Tiles guard can step into and fall into.
+    uint64_t open[MAP_MAX_HEIGHT];
+    uint64_t drop[MAP_MAX_HEIGHT];
+    // Tiles reached so far and on the last step.
+    uint64_t seen[MAP_MAX_HEIGHT];
+    uint64_t front[MAP_MAX_HEIGHT];
+    // Tiles of the last step guard can step and fall into. Row y is stored
+    // at y + 1, so the rows above and below the map are empty.
+    uint64_t in[MAP_MAX_HEIGHT + 2];
+    uint64_t fall[MAP_MAX_HEIGHT + 2];
+
+    for (int y = 0; y < h; y++) {
+        uint64_t *b = map_boards(game, y);
+        uint64_t space = b[MAP_BOARD_EMPTY] | b[MAP_BOARD_LADDER]
+            | b[MAP_BOARD_ROPE];
+        stand[y] = space | b[MAP_BOARD_FALSE];
+        ladder[y] = b[MAP_BOARD_LADDER];
+        open[y] = space & ~b[MAP_BOARD_HOLE];
+        drop[y] = open[y] | b[MAP_BOARD_FALSE];
+        held[y] = ai_span(0, w - 1);
+        if (y < h - 1) {
+            uint64_t *n = map_boards(game, y + 1);
+            held[y] = b[MAP_BOARD_LADDER] | b[MAP_BOARD_ROPE]
+                | n[MAP_BOARD_BRICK] | n[MAP_BOARD_HOLE] | n[MAP_BOARD_SOLID]
+                | n[MAP_BOARD_LADDER];
+        }
+    }
+    memset(seen, 0, sizeof(seen[0]) * h);
+    memset(in, 0, sizeof(in[0]) * (h + 2));
+    memset(fall, 0, sizeof(fall[0]) * (h + 2));
+    memset(game_array(game, game->ai_flow), DIR_NONE, (size_t) w * h);
+
+    seen[ry] = (uint64_t) 1 << rx;
+    in[ry + 1] = seen[ry] & open[ry];
+    fall[ry + 1] = seen[ry] & drop[ry];
+    // Rows the last step has reached.
+    int lo = ry;
+    int hi = ry;
+    while (lo <= hi) {
+        int from = lo > 0 ? lo - 1 : 0;
+        int to = hi < h - 1 ? hi + 1 : h - 1;
+        lo = h;
+        hi = -1;
+        for (int y = from; y <= to; y++) {
+            uint64_t *i = &in[y + 1];
+            front[y] = 0;
+            if ((i[-1] | i[0] | i[1] | fall[y + 2]) == 0) {
+                continue;
+            }
+
+            uint64_t free = stand[y] & ~seen[y];
+            uint64_t walk = free & held[y];
+            uint64_t steps[] = {
+                [DIR_DOWN] = walk & i[1],
+                [DIR_FALL] = free & ~held[y] & fall[y + 2],
+                [DIR_LEFT] = walk & i[0] << 1,
+                [DIR_RIGHT] = walk & i[0] >> 1,
+                [DIR_NONE] = 0,
+                [DIR_UP] = walk & ladder[y] & i[-1],
+            };
+            uint8_t *row = ai_flow_row(game, y);
+            for (int d = 0; d <= DIR_UP; d++) {
+                uint64_t m = steps[d] & ~front[y];
+                front[y] |= m;
+                for (; m != 0; m &= m - 1) {
+                    row[__builtin_ctzll(m)] = d;
+                }
+            }
+            if (front[y] != 0) {
+                seen[y] |= front[y];
+                lo = y < lo ? y : lo;
+                hi = y;
+            }
+        }
+        for (int y = from; y <= to; y++) {
+            in[y + 1] = front[y] & open[y];
+            fall[y + 1] = front[y] & drop[y];
+        }
+    }
+
+    game->ai_flowver = game->map.version;
+    game->ai_flowx = rx;
+    game->ai_flowy = ry;
+}
+
+// Rebuild flow field if the map or the runner's tile have changed since it
+// was built.
+static void ai_flow_validate(struct game *game)
+{
+    if (game->ai_flowver != game->map.version
+        || game->ai_flowx != game->runner.x
+        || game->ai_flowy != game->runner.y) {
+        ai_flow_build(game);
+    }
+}
+
+// Look for the direction to move the guard in the flow field. Guard's own
+// situation (climbing out of the hole, falling) is handled as ai_scan()
+// does. Where the field has no answer, e.g. the runner is unreachable or
+// the guard is on the runner's tile, the route scan decides.
+static enum dir ai_flow(struct game *game, struct guard *guard,
+    struct ai_log *log)
+{
+    if (guard->state == GSTATE_CLIMB_OUT) {
+        return DIR_UP;
+    }
+    if (!guard->hole && ai_falling(game, guard)) {
+        return DIR_FALL;
+    }
+
+    enum dir d = ai_flow_row(game, guard->y)[guard->x];
+    if (d == DIR_NONE || d == DIR_FALL || (guard->hole && d == DIR_DOWN)) {
+        return ai_scan(game, guard, log);
+    }
+
+    return d;
+}
+
+// Look for the direction to move the guard to. Game is only read if log is
+// not NULL, see ai_memo().
+static enum dir ai_decide(struct game *game, struct guard *guard,
+    struct ai_log *log)
+{
+    if (game->ai_mode == AI_MODE_FLOW) {
+        return ai_flow(game, guard, log);
+    }
+
+    return ai_scan(game, guard, log);
+}
+
 // Make guard to make a single step in the calculated direction if we can.
 static void ai_move_guard(struct game *game, struct guard *guard, enum dir d)
 {
@@ -637,115 +921,301 @@ static void ai_move_guard(struct game *game, struct guard *guard, enum dir d)
     }
 
     if (move) {
-        guard->x = x;
-        guard->y = y;
+        guard_move(game, guard, x, y);
         guard->tx = tx;
         guard->ty = ty;
-        animation_tick(guard->cura);
+        animation_tick(&guard->cura);
     }
     if (guard->state != state) {
         // When stopped keep current animation.
         if (state != GSTATE_STOP) {
-            guard->cura = guard_state_animation(guard, state);
-            animation_reset(guard->cura);
+            animation_init(&guard->cura, guard_state_animation(state));
         }
         guard->state = state;
+        if (state == GSTATE_TRAP_LEFT || state == GSTATE_TRAP_RIGHT) {
+            // Trap animation is first ticked on this very tick and the
+            // guard climbs out when it ends.
+            guard->timer = timer_add(&game->timers,
+                animation_length(guard_state_animation(state)) - 1,
+                TIMER_GUARD_TRAP, guard - game_guards(game), 0);
+        }
+    }
+}
+
+// Guard's direction looked for on a pool's worker, see ai_move_parallel().
+struct ai_decision {
+    int guard;
+    enum dir dir;
+    // Routes traced by the worker, memoized when all workers are done.
+    struct ai_log log;
+};
+
+// Guards' directions looked for by a single task.
+struct ai_batch {
+    struct game *game;
+    struct ai_decision *decisions;
+    int n;
+};
+
+static void ai_batch_run(void *arg)
+{
+    struct ai_batch *b = arg;
+
+    for (int i = 0; i < b->n; i++) {
+        struct ai_decision *d = &b->decisions[i];
+        d->log.n = 0;
+        d->dir = ai_decide(b->game, &game_guards(b->game)[d->guard],
+            &d->log);
+    }
+}
+
+// Move guards scheduled for this tick in two phases. First directions of
+// all of them are looked for in parallel, split into a task per pool's
+// thread and the calling one. Tasks only read the game and write into
+// their own decisions. Then guards are moved one
+// by one in the schedule order as ai_tick() does.
+//
+// Guards' moves during a tick change neither the map nor the runner, so a
+// direction looked for at the beginning of the tick is still valid when
+// the guard's turn comes, except falling which depends on guards below.
+// Falling is checked again, and the guard is decided for once more in the
+// rare case it no longer falls. A guard scheduled twice gets its second
+// direction looked for after its first move. So the moves are exactly the
+// ones of ai_tick() one by one.
+static void ai_move_parallel(struct game *game, int moves)
+{
+    struct ai_decision decisions[MP_NMOVES_MAX];
+    struct ai_batch batches[MP_NMOVES_MAX];
+    int sched[MP_NMOVES_MAX];
+    bool decided[MAX_GUARDS] = {false};
+    struct pool_group group;
+    int n = 0;
+
+    for (int i = 0; i < moves; i++) {
+        if (++game->ai_iguard >= game->nguards) {
+            game->ai_iguard = 0;
+        }
+        sched[i] = game->ai_iguard;
+
+        struct guard *g = &game_guards(game)[sched[i]];
+        if (!decided[sched[i]] && g->state != GSTATE_TRAP_LEFT
+            && g->state != GSTATE_TRAP_RIGHT
+            && g->state != GSTATE_REBORN) {
+            decided[sched[i]] = true;
+            decisions[n++].guard = sched[i];
+        }
+    }
+
+    int nbatches = pool_size(game->ai_pool) + 1;
+    if (nbatches > n) {
+        nbatches = n;
+    }
+    pool_group_init(&group);
+    for (int i = 0; i < nbatches; i++) {
+        struct ai_batch *b = &batches[i];
+        int first = n * i / nbatches;
+        b->game = game;
+        b->decisions = &decisions[first];
+        b->n = n * (i + 1) / nbatches - first;
+        pool_submit(game->ai_pool, &group, ai_batch_run, b);
+    }
+    pool_wait(game->ai_pool, &group);
+
+    // Routes depend only on the map and the runner's row, so the ones
+    // traced by different workers agree.
+    for (int i = 0; i < n; i++) {
+        struct ai_log *log = &decisions[i].log;
+        for (int j = 0; j < log->n; j++) {
+            struct ai_route *r = &log->routes[j];
+            ai_memo(game, NULL, r->x, r->y, r->up, r->end);
+        }
+    }
+
+    for (int i = 0, k = 0; i < moves; i++) {
+        struct guard *g = &game_guards(game)[sched[i]];
+        if (g->state == GSTATE_TRAP_LEFT
+            || g->state == GSTATE_TRAP_RIGHT
+            || g->state == GSTATE_REBORN) {
+            continue;
+        }
+
+        enum dir d;
+        if (k < n && decisions[k].guard == sched[i]) {
+            d = decisions[k++].dir;
+            if (g->state != GSTATE_CLIMB_OUT) {
+                if (!g->hole && ai_falling(game, g)) {
+                    d = DIR_FALL;
+                } else if (d == DIR_FALL) {
+                    // Another guard has moved below.
+                    d = ai_decide(game, g, NULL);
+                }
+            }
+        } else {
+            d = ai_decide(game, g, NULL);
+        }
+        ai_move_guard(game, g, d);
     }
 }
 
 // Set guard into reborn state after he died immured in the wall.
 void ai_reborn(struct game *game, struct guard *guard)
 {
-    int x = ai_rand_rebornx();
+    int x = ai_rand_rebornx(game);
     int y = 1;
     int xs = x;
 
     // Avoid guard to be born in holes or where gold lays.
     // TODO: Add gold check.
     while (!is_tile(game, x, y, MAP_TILE_EMPTY) || ai_hole(game, x, y)) {
-        x = ai_rand_rebornx();
+        x = ai_rand_rebornx(game);
         if (x == xs) {
             // We have tried all positions this row, let's move to the next one.
             y++;
-            if (y == MAP_HEIGHT) {
+            if (y == game->map.h) {
                 die("guard cannot be born");
             }
         }
     }
 
-    guard->x = x;
-    guard->y = y;
+    guard_move(game, guard, x, y);
     guard->hole = false;
     guard->holey = -1;
     guard->state = GSTATE_REBORN;
-    guard->cura = guard_state_animation(guard, GSTATE_REBORN);
+    animation_init(&guard->cura, guard_state_animation(GSTATE_REBORN));
+    // Guard immured in the hole is not going to climb out of it.
+    if (guard->timer != TIMER_NONE) {
+        timer_cancel(&game->timers, guard->timer);
+    }
+    guard->timer = timer_add(&game->timers,
+        animation_length(ANIMATION_GUARD_REBORN), TIMER_GUARD_REBORN,
+        guard - game_guards(game), 0);
 
     // If guard dies still holding gold means that he could not drop it earlier.
     // Gold must be discarded in this case as a result runner have to pickup
     // one gold less.
-    if (guard->gold != NULL) {
+    if (guard->gold != -1) {
         game_discard_gold(game, guard->gold);
-        guard->gold = NULL;
+        guard->gold = -1;
         guard->goldholds = 0;
     }
 }
 
+// Parse AI mode name: "flow" or "scan". Return -1 if the name is unknown.
+int ai_mode_parse(char *s)
+{
+    if (strcmp(s, "flow") == 0) {
+        return AI_MODE_FLOW;
+    } else if (strcmp(s, "scan") == 0) {
+        return AI_MODE_SCAN;
+    }
+
+    return -1;
+}
+
+// Initialize AI state of the new game played with options opts, route scan
+// one guard by one if opts is NULL. Must be called after the map is loaded.
+void ai_init(struct game *game, struct game_opts *opts)
+{
+    game->ai_mode = opts != NULL ? opts->ai_mode : AI_MODE_SCAN;
+    game->ai_pool = opts != NULL ? opts->pool : NULL;
+    game->ai_imoves = MP_NMOVES;
+    game->ai_iguard = 0;
+    game->ai_irebornx = game->map.w;
+    game->ai_scanry = -1;
+    game->ai_flowx = -1;
+
+    // Base tiles never change during the game, so the columns guard can
+    // walk through are computed once.
+    uint64_t *walks = game_array(game, game->ai_walk);
+    for (int y = 0; y < game->map.h; y++) {
+        uint64_t walk = 0;
+        for (int x = 0; x < game->map.w; x++) {
+            enum map_tile_t lvl = map_baset(game, y)[x];
+            enum map_tile_t nextlvl = MAP_TILE_SOLID;
+            if (y < game->map.h - 1) {
+                nextlvl = map_baset(game, y + 1)[x];
+            }
+            if (lvl == MAP_TILE_LADDER || lvl == MAP_TILE_ROPE
+                || nextlvl == MAP_TILE_SOLID || nextlvl == MAP_TILE_LADDER
+                || nextlvl == MAP_TILE_BRICK) {
+                walk |= (uint64_t) 1 << x;
+            }
+        }
+        walks[y] = walk;
+    }
+}
+
 // Callback to move guards.
 // Called on every game loop tick, calculates direction to move for every
 // guard and make the move. On every call a few guards are moved depends on
 // the policy defined by move_policy table.
 void ai_tick(struct game *game)
 {
-    static int imoves = MP_NMOVES;
-    static int iguard = 0;
-
-    if (++imoves >= MP_NMOVES) {
-        imoves = 0;
+    if (++game->ai_imoves >= MP_NMOVES) {
+        game->ai_imoves = 0;
     }
 
-    // Regular (running) guards move logic.
-    int moves = move_policy[game->nguards][imoves];
+    // Regular (running) guards move logic. Routes and the flow field are
+    // traced at most once per tick and only when some guards move.
+    int moves = ai_moves(game->nguards, game->ai_imoves);
+    if (moves > 0) {
+        ai_scan_validate(game);
+        if (game->ai_mode == AI_MODE_FLOW) {
+            ai_flow_validate(game);
+        }
+    }
+    if (game->ai_pool != NULL && moves >= AI_PARALLEL_MOVES) {
+        ai_move_parallel(game, moves);
+        moves = 0;
+    }
     while (moves-- > 0) {
-        if (++iguard >= game->nguards) {
-            iguard = 0;
+        if (++game->ai_iguard >= game->nguards) {
+            game->ai_iguard = 0;
         }
 
-        struct guard *g = game->guards[iguard];
+        struct guard *g = &game_guards(game)[game->ai_iguard];
         if (g->state == GSTATE_TRAP_LEFT
             || g->state == GSTATE_TRAP_RIGHT
             || g->state == GSTATE_REBORN) {
             continue;
         }
 
-        enum dir d = ai_scan(game, g);
+        enum dir d = ai_decide(game, g, NULL);
         ai_move_guard(game, g, d);
     }
 
-    // Rebornd and trapped guards climbing out logic.
+    // Rebornd and trapped guards climbing out logic: guards whose timers
+    // are due change their state, others only play their animations.
+    // TODO: Make sure the runner can dig 3 holes, traps 3 guards
+    //       and run over them.
+    int i, y;
+    while (timer_expired(&game->timers, TIMER_GUARD_TRAP, &i, &y)) {
+        struct guard *g = &game_guards(game)[i];
+        g->timer = TIMER_NONE;
+        g->state = GSTATE_CLIMB_OUT;
+        animation_init(&g->cura, guard_state_animation(GSTATE_CLIMB_OUT));
+    }
+    while (timer_expired(&game->timers, TIMER_GUARD_REBORN, &i, &y)) {
+        struct guard *g = &game_guards(game)[i];
+        g->timer = TIMER_NONE;
+        g->state = GSTATE_FALL_RIGHT;
+        animation_init(&g->cura, guard_state_animation(GSTATE_FALL_RIGHT));
+    }
     for (int i = 0; i < game->nguards; i++) {
-        struct guard *g = game->guards[i];
+        struct guard *g = &game_guards(game)[i];
 
         if (g->state == GSTATE_TRAP_LEFT
-            || g->state == GSTATE_TRAP_RIGHT) {
-            // TODO: Make sure the runner can dig 3 holes, traps 3 guards
-            //       and run over them.
-            if (animation_tick(g->cura)) {
-                g->state = GSTATE_CLIMB_OUT;
-                g->cura = guard_state_animation(g, GSTATE_CLIMB_OUT);
-            }
-        } else if (g->state == GSTATE_REBORN) {
-            if (animation_tick(g->cura)) {
-                g->state = GSTATE_FALL_RIGHT;
-                g->cura = guard_state_animation(g, GSTATE_FALL_RIGHT);
-            }
+            || g->state == GSTATE_TRAP_RIGHT
+            || g->state == GSTATE_REBORN) {
+            animation_tick(&g->cura);
         }
 
         // Pick up gold when step over it.
-        if (g->gold == NULL && g->goldholds == 0) {
-            struct gold *gld = gold_pickup(game, g->x, g->y, g->tx, g->ty);
-            if (gld != NULL) {
+        if (g->gold == -1 && g->goldholds == 0) {
+            int gld = gold_pickup(game, g->x, g->y, g->tx, g->ty);
+            if (gld != -1) {
                 g->gold = gld;
-                g->goldholds = ai_rand_goldholds();
+                g->goldholds = ai_rand_goldholds(game);
             }
         }
 
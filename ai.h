@@ -3,6 +3,8 @@
 
 #include "game.h"
 
+int ai_mode_parse(char *s);
+void ai_init(struct game *game, struct game_opts *opts);
 void ai_tick(struct game *game);
 
 #endif /* AI_H_ */
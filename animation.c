@@ -1,17 +1,37 @@
+#include <pthread.h>
 #include <stdbool.h>
-#include <SDL2/SDL_image.h>
 #include "texture.h"
 #include "animation.h"
 #include "exit.h"
-#include "xmalloc.h"
 #include "tile.h"
 
+// Capacity of the static sprite tables below.
+#define SPRITES_MAX 128
+#define SPRITE_LISTS_MAX 128
+
+// NULL-terminated sprites lists of every animation type. Sprites refer to
+// textures by id, so they do not depend on the loaded texture set, never
+// change once built and are shared by all animations and games. Sprites
+// and lists are stored in static tables, nothing is allocated.
+static struct sprite **sprites[ANIMATION_SIZE];
+static pthread_once_t sprites_once = PTHREAD_ONCE_INIT;
+static struct sprite sprite_defs[SPRITES_MAX];
+static int nsprite_defs = 0;
+static struct sprite *sprite_lists[SPRITE_LISTS_MAX];
+static int nsprite_lists = 0;
 
 static struct sprite *animation_sprite_init(enum texture tx, int x, int y,
     int w, int h, int frames)
 {
-    struct sprite *s = xmalloc(sizeof(struct sprite));
-    s->texture = texture_get(tx);
+    if (nsprite_defs == SPRITES_MAX) {
+        die("sprites limit exceeded");
+    }
+    // Has to fit into struct animation's frame counter.
+    if (frames > UINT8_MAX) {
+        die("too many sprite frames %d", frames);
+    }
+    struct sprite *s = &sprite_defs[nsprite_defs++];
+    s->texture = tx;
     s->x = x;
     s->y = y;
     s->w = w;
@@ -23,7 +43,13 @@ static struct sprite *animation_sprite_init(enum texture tx, int x, int y,
 
 static struct sprite **sprites_init(int size)
 {
-    return xmalloc(sizeof(struct sprite) * size);
+    if (nsprite_lists + size > SPRITE_LISTS_MAX) {
+        die("sprite lists limit exceeded");
+    }
+    struct sprite **s = &sprite_lists[nsprite_lists];
+    nsprite_lists += size;
+
+    return s;
 }
 
 static struct sprite *runner_sprite_init(int n, int frames)
@@ -60,224 +86,249 @@ static struct sprite *hole_sprite_init(int n, bool tall, int frames)
         frames);
 }
 
-struct animation *animation_init(enum animation_t t)
+static struct sprite **animation_sprites_init(enum animation_t t)
 {
-    struct animation *a = xmalloc(sizeof(struct animation));
+    struct sprite **s;
 
     switch (t) {
     case ANIMATION_BRICK:
-        a->sprites = sprites_init(2);
-        a->sprites[0] = animation_sprite_init(TEXTURE_BRICK, 0, 0,
+        s = sprites_init(2);
+        s[0] = animation_sprite_init(TEXTURE_BRICK, 0, 0,
             TILE_MAP_WIDTH, TILE_MAP_HEIGHT, 1);
-        a->sprites[1] = NULL;
+        s[1] = NULL;
         break;
     case ANIMATION_GOLD:
-        a->sprites = sprites_init(2);
-        a->sprites[0] = animation_sprite_init(TEXTURE_GOLD, 0, 0,
+        s = sprites_init(2);
+        s[0] = animation_sprite_init(TEXTURE_GOLD, 0, 0,
             TILE_MAP_WIDTH, TILE_MAP_HEIGHT, 1);
-        a->sprites[1] = NULL;
+        s[1] = NULL;
         break;
     case ANIMATION_GROUND:
-        a->sprites = sprites_init(2);
-        a->sprites[0] = animation_sprite_init(TEXTURE_GROUND, 0, 0,
+        s = sprites_init(2);
+        s[0] = animation_sprite_init(TEXTURE_GROUND, 0, 0,
             TILE_GROUND_WIDTH, TILE_GROUND_HEIGHT, 1);
-        a->sprites[1] = NULL;
+        s[1] = NULL;
         break;
     case ANIMATION_GUARD_CLIMB_LEFT:
-        a->sprites = sprites_init(4);
-        a->sprites[0] = guard_sprite_init(25, 1);
-        a->sprites[1] = guard_sprite_init(26, 2);
-        a->sprites[2] = guard_sprite_init(27, 2);
-        a->sprites[3] = NULL;
+        s = sprites_init(4);
+        s[0] = guard_sprite_init(25, 1);
+        s[1] = guard_sprite_init(26, 2);
+        s[2] = guard_sprite_init(27, 2);
+        s[3] = NULL;
         break;
     case ANIMATION_GUARD_CLIMB_RIGHT:
-        a->sprites = sprites_init(4);
-        a->sprites[0] = guard_sprite_init(22, 1);
-        a->sprites[1] = guard_sprite_init(23, 2);
-        a->sprites[2] = guard_sprite_init(24, 2);
-        a->sprites[3] = NULL;
+        s = sprites_init(4);
+        s[0] = guard_sprite_init(22, 1);
+        s[1] = guard_sprite_init(23, 2);
+        s[2] = guard_sprite_init(24, 2);
+        s[3] = NULL;
         break;
     case ANIMATION_GUARD_FALL_LEFT:
-        a->sprites = sprites_init(2);
-        a->sprites[0] = guard_sprite_init(30, 1);
-        a->sprites[1] = NULL;
+        s = sprites_init(2);
+        s[0] = guard_sprite_init(30, 1);
+        s[1] = NULL;
         break;
     case ANIMATION_GUARD_FALL_RIGHT:
-        a->sprites = sprites_init(2);
-        a->sprites[0] = guard_sprite_init(8, 1);
-        a->sprites[1] = NULL;
+        s = sprites_init(2);
+        s[0] = guard_sprite_init(8, 1);
+        s[1] = NULL;
         break;
     case ANIMATION_GUARD_LEFT:
-        a->sprites = sprites_init(4);
-        a->sprites[0] = guard_sprite_init(3, 2);
-        a->sprites[1] = guard_sprite_init(4, 2);
-        a->sprites[2] = guard_sprite_init(5, 2);
-        a->sprites[3] = NULL;
+        s = sprites_init(4);
+        s[0] = guard_sprite_init(3, 2);
+        s[1] = guard_sprite_init(4, 2);
+        s[2] = guard_sprite_init(5, 2);
+        s[3] = NULL;
         break;
     case ANIMATION_GUARD_REBORN:
-        a->sprites = sprites_init(3);
-        a->sprites[0] = guard_sprite_init(28, 6);
-        a->sprites[1] = guard_sprite_init(29, 2);
-        a->sprites[2] = NULL;
+        s = sprites_init(3);
+        s[0] = guard_sprite_init(28, 6);
+        s[1] = guard_sprite_init(29, 2);
+        s[2] = NULL;
         break;
     case ANIMATION_GUARD_RIGHT:
-        a->sprites = sprites_init(4);
-        a->sprites[0] = guard_sprite_init(0, 2);
-        a->sprites[1] = guard_sprite_init(1, 2);
-        a->sprites[2] = guard_sprite_init(2, 2);
-        a->sprites[3] = NULL;
+        s = sprites_init(4);
+        s[0] = guard_sprite_init(0, 2);
+        s[1] = guard_sprite_init(1, 2);
+        s[2] = guard_sprite_init(2, 2);
+        s[3] = NULL;
         break;
     case ANIMATION_GUARD_TRAP_LEFT:
-        a->sprites = sprites_init(7);
-        a->sprites[0] = guard_sprite_init(30, 51);
-        a->sprites[1] = guard_sprite_init(31, 3);
-        a->sprites[2] = guard_sprite_init(32, 3);
-        a->sprites[3] = guard_sprite_init(31, 3);
-        a->sprites[4] = guard_sprite_init(32, 3);
-        a->sprites[5] = guard_sprite_init(30, 3);
-        a->sprites[6] = NULL;
+        s = sprites_init(7);
+        s[0] = guard_sprite_init(30, 51);
+        s[1] = guard_sprite_init(31, 3);
+        s[2] = guard_sprite_init(32, 3);
+        s[3] = guard_sprite_init(31, 3);
+        s[4] = guard_sprite_init(32, 3);
+        s[5] = guard_sprite_init(30, 3);
+        s[6] = NULL;
         break;
     case ANIMATION_GUARD_TRAP_RIGHT:
-        a->sprites = sprites_init(7);
-        a->sprites[0] = guard_sprite_init(8, 51);
-        a->sprites[1] = guard_sprite_init(9, 3);
-        a->sprites[2] = guard_sprite_init(10, 3);
-        a->sprites[3] = guard_sprite_init(9, 3);
-        a->sprites[4] = guard_sprite_init(10, 3);
-        a->sprites[5] = guard_sprite_init(8, 3);
-        a->sprites[6] = NULL;
+        s = sprites_init(7);
+        s[0] = guard_sprite_init(8, 51);
+        s[1] = guard_sprite_init(9, 3);
+        s[2] = guard_sprite_init(10, 3);
+        s[3] = guard_sprite_init(9, 3);
+        s[4] = guard_sprite_init(10, 3);
+        s[5] = guard_sprite_init(8, 3);
+        s[6] = NULL;
         break;
     case ANIMATION_GUARD_UPDOWN:
-        a->sprites = sprites_init(3);
-        a->sprites[0] = guard_sprite_init(6, 1);
-        a->sprites[1] = guard_sprite_init(7, 1);
-        a->sprites[2] = NULL;
+        s = sprites_init(3);
+        s[0] = guard_sprite_init(6, 1);
+        s[1] = guard_sprite_init(7, 1);
+        s[2] = NULL;
         break;
     case ANIMATION_HOLE_FILL:
-        a->sprites = sprites_init(5);
-        a->sprites[0] = hole_sprite_init(26, false, 166);
-        a->sprites[1] = hole_sprite_init(17, false, 8);
-        a->sprites[2] = hole_sprite_init(8, false, 8);
+        s = sprites_init(5);
+        s[0] = hole_sprite_init(26, false, 166);
+        s[1] = hole_sprite_init(17, false, 8);
+        s[2] = hole_sprite_init(8, false, 8);
         // TODO: Why do we need 4-th sprite???
-        a->sprites[3] = hole_sprite_init(35, false, 4);
-        a->sprites[4] = NULL;
+        s[3] = hole_sprite_init(35, false, 4);
+        s[4] = NULL;
         break;
     case ANIMATION_LADDER:
-        a->sprites = sprites_init(2);
-        a->sprites[0] = animation_sprite_init(TEXTURE_LADDER, 0, 0,
+        s = sprites_init(2);
+        s[0] = animation_sprite_init(TEXTURE_LADDER, 0, 0,
             TILE_MAP_WIDTH, TILE_MAP_HEIGHT, 1);
-        a->sprites[1] = NULL;
+        s[1] = NULL;
         break;
     case ANIMATION_ROPE:
-        a->sprites = sprites_init(2);
-        a->sprites[0] = animation_sprite_init(TEXTURE_ROPE, 0, 0,
+        s = sprites_init(2);
+        s[0] = animation_sprite_init(TEXTURE_ROPE, 0, 0,
             TILE_MAP_WIDTH, TILE_MAP_HEIGHT, 1);
-        a->sprites[1] = NULL;
+        s[1] = NULL;
         break;
     case ANIMATION_RUNNER_CLIMB_LEFT:
-        a->sprites = sprites_init(4);
-        a->sprites[0] = runner_sprite_init(21, 1);
-        a->sprites[1] = runner_sprite_init(22, 2);
-        a->sprites[2] = runner_sprite_init(23, 2);
-        a->sprites[3] = NULL;
+        s = sprites_init(4);
+        s[0] = runner_sprite_init(21, 1);
+        s[1] = runner_sprite_init(22, 2);
+        s[2] = runner_sprite_init(23, 2);
+        s[3] = NULL;
         break;
     case ANIMATION_RUNNER_CLIMB_RIGHT:
-        a->sprites = sprites_init(4);
-        a->sprites[0] = runner_sprite_init(18, 1);
-        a->sprites[1] = runner_sprite_init(19, 2);
-        a->sprites[2] = runner_sprite_init(20, 2);
-        a->sprites[3] = NULL;
+        s = sprites_init(4);
+        s[0] = runner_sprite_init(18, 1);
+        s[1] = runner_sprite_init(19, 2);
+        s[2] = runner_sprite_init(20, 2);
+        s[3] = NULL;
         break;
     case ANIMATION_RUNNER_DIG_LEFT:
         // Repeat dig animation as many sprites as hole digging animation
         // lasts so they have the same duration.
-        a->sprites = sprites_init(2);
-        a->sprites[0] = runner_sprite_init(25, 11);
-        a->sprites[1] = NULL;
+        s = sprites_init(2);
+        s[0] = runner_sprite_init(25, 11);
+        s[1] = NULL;
         break;
     case ANIMATION_RUNNER_DIG_RIGHT:
         // Repeat dig animation as many sprites as hole digging animation
         // lasts so they have the same duration.
-        a->sprites = sprites_init(2);
-        a->sprites[0] = runner_sprite_init(24, 11);
-        a->sprites[2] = NULL;
+        s = sprites_init(2);
+        s[0] = runner_sprite_init(24, 11);
+        s[1] = NULL;
         break;
     case ANIMATION_RUNNER_FALL_LEFT:
-        a->sprites = sprites_init(2);
-        a->sprites[0] = runner_sprite_init(26, 1);
-        a->sprites[1] = NULL;
+        s = sprites_init(2);
+        s[0] = runner_sprite_init(26, 1);
+        s[1] = NULL;
         break;
     case ANIMATION_RUNNER_FALL_RIGHT:
-        a->sprites = sprites_init(2);
-        a->sprites[0] = runner_sprite_init(8, 1);
-        a->sprites[1] = NULL;
+        s = sprites_init(2);
+        s[0] = runner_sprite_init(8, 1);
+        s[1] = NULL;
         break;
     case ANIMATION_RUNNER_HOLE_LEFT:
-        a->sprites = sprites_init(9);
-        a->sprites[0] = hole_sprite_init(0, true, 1);
-        a->sprites[1] = hole_sprite_init(1, true, 1);
-        a->sprites[2] = hole_sprite_init(2, true, 2);
-        a->sprites[3] = hole_sprite_init(3, true, 1);
-        a->sprites[4] = hole_sprite_init(4, true, 2);
-        a->sprites[5] = hole_sprite_init(5, true, 1);
-        a->sprites[6] = hole_sprite_init(6, true, 2);
-        a->sprites[7] = hole_sprite_init(7, true, 1);
-        a->sprites[8] = NULL;
+        s = sprites_init(9);
+        s[0] = hole_sprite_init(0, true, 1);
+        s[1] = hole_sprite_init(1, true, 1);
+        s[2] = hole_sprite_init(2, true, 2);
+        s[3] = hole_sprite_init(3, true, 1);
+        s[4] = hole_sprite_init(4, true, 2);
+        s[5] = hole_sprite_init(5, true, 1);
+        s[6] = hole_sprite_init(6, true, 2);
+        s[7] = hole_sprite_init(7, true, 1);
+        s[8] = NULL;
         break;
     case ANIMATION_RUNNER_HOLE_RIGHT:
-        a->sprites = sprites_init(9);
-        a->sprites[0] = hole_sprite_init(9, true, 1);
-        a->sprites[1] = hole_sprite_init(10, true, 1);
-        a->sprites[2] = hole_sprite_init(11, true, 2);
-        a->sprites[3] = hole_sprite_init(12, true, 1);
-        a->sprites[4] = hole_sprite_init(13, true, 2);
-        a->sprites[5] = hole_sprite_init(14, true, 1);
-        a->sprites[6] = hole_sprite_init(15, true, 2);
-        a->sprites[7] = hole_sprite_init(16, true, 1);
-        a->sprites[8] = NULL;
+        s = sprites_init(9);
+        s[0] = hole_sprite_init(9, true, 1);
+        s[1] = hole_sprite_init(10, true, 1);
+        s[2] = hole_sprite_init(11, true, 2);
+        s[3] = hole_sprite_init(12, true, 1);
+        s[4] = hole_sprite_init(13, true, 2);
+        s[5] = hole_sprite_init(14, true, 1);
+        s[6] = hole_sprite_init(15, true, 2);
+        s[7] = hole_sprite_init(16, true, 1);
+        s[8] = NULL;
         break;
     case ANIMATION_RUNNER_LEFT:
-        a->sprites = sprites_init(4);
-        a->sprites[0] = runner_sprite_init(3, 2);
-        a->sprites[1] = runner_sprite_init(4, 2);
-        a->sprites[2] = runner_sprite_init(5, 2);
-        a->sprites[3] = NULL;
+        s = sprites_init(4);
+        s[0] = runner_sprite_init(3, 2);
+        s[1] = runner_sprite_init(4, 2);
+        s[2] = runner_sprite_init(5, 2);
+        s[3] = NULL;
         break;
     case ANIMATION_RUNNER_RIGHT:
-        a->sprites = sprites_init(4);
-        a->sprites[0] = runner_sprite_init(0, 2);
-        a->sprites[1] = runner_sprite_init(1, 2);
-        a->sprites[2] = runner_sprite_init(2, 2);
-        a->sprites[3] = NULL;
+        s = sprites_init(4);
+        s[0] = runner_sprite_init(0, 2);
+        s[1] = runner_sprite_init(1, 2);
+        s[2] = runner_sprite_init(2, 2);
+        s[3] = NULL;
         break;
     case ANIMATION_RUNNER_UPDOWN:
-        a->sprites = sprites_init(3);
-        a->sprites[0] = runner_sprite_init(6, 1);
-        a->sprites[1] = runner_sprite_init(7, 1);
-        a->sprites[2] = NULL;
+        s = sprites_init(3);
+        s[0] = runner_sprite_init(6, 1);
+        s[1] = runner_sprite_init(7, 1);
+        s[2] = NULL;
         break;
     case ANIMATION_SOLID:
-        a->sprites = sprites_init(2);
-        a->sprites[0] = animation_sprite_init(TEXTURE_SOLID, 0, 0,
+        s = sprites_init(2);
+        s[0] = animation_sprite_init(TEXTURE_SOLID, 0, 0,
             TILE_MAP_WIDTH, TILE_MAP_HEIGHT, 1);
-        a->sprites[1] = NULL;
+        s[1] = NULL;
         break;
     default:
         die("illegal state");
     }
 
-    animation_reset(a);
+    return s;
+}
+
+static void animation_defs_init()
+{
+    for (int i = 0; i < ANIMATION_SIZE; i++) {
+        if (i != ANIMATION_NONE) {
+            sprites[i] = animation_sprites_init(i);
+        }
+    }
+}
+
+/*
+ * Initialize animation of the given type and reset it to the first sprite.
+ */
+void animation_init(struct animation *a, enum animation_t t)
+{
+    pthread_once(&sprites_once, animation_defs_init);
 
-    return a;
+    a->type = t;
+    animation_reset(a);
 }
 
-void animation_destroy(struct animation *a)
+/*
+ * Return number of ticks animation of the given type takes, i.e. how many
+ * animation_tick() calls it takes to reach its end.
+ */
+int animation_length(enum animation_t t)
 {
-    for (struct sprite **s = a->sprites; *s != NULL; s++) {
-        free(*s);
+    pthread_once(&sprites_once, animation_defs_init);
+
+    int n = 0;
+    for (struct sprite **s = sprites[t]; *s != NULL; s++) {
+        n += (*s)->frames + 1;
     }
-    free(a->sprites);
-    free(a);
+
+    return n;
 }
 
 /*
@@ -296,11 +347,11 @@ bool animation_tick(struct animation *a)
     } else {
         // Move to the next sprite.
         a->cur++;
-        if (*(a->cur) == NULL) {
+        if (sprites[a->type][a->cur] == NULL) {
             replay = true;
             animation_reset(a);
         } else {
-            a->frame = (*(a->cur))->frames;
+            a->frame = sprites[a->type][a->cur]->frames;
         }
     }
 
@@ -312,6 +363,18 @@ bool animation_tick(struct animation *a)
  */
 void animation_reset(struct animation *a)
 {
-    a->cur = a->sprites;
-    a->frame = (*(a->cur))->frames;
+    a->cur = 0;
+    a->frame = a->type != ANIMATION_NONE ? sprites[a->type][0]->frames : 0;
+}
+
+/*
+ * Return currently displayed sprite, NULL for ANIMATION_NONE.
+ */
+struct sprite *animation_sprite(struct animation *a)
+{
+    if (a->type == ANIMATION_NONE) {
+        return NULL;
+    }
+
+    return sprites[a->type][a->cur];
 }
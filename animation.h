@@ -2,7 +2,7 @@
 #define ANIMATION_H_
 
 #include <stdbool.h>
-#include <SDL2/SDL.h>
+#include <stdint.h>
 #include "texture.h"
 
 enum animation_t {
@@ -21,6 +21,8 @@ enum animation_t {
     ANIMATION_GUARD_UPDOWN,
     ANIMATION_HOLE_FILL,
     ANIMATION_LADDER,
+    // No animation, nothing is displayed.
+    ANIMATION_NONE,
     ANIMATION_ROPE,
     ANIMATION_RUNNER_CLIMB_LEFT,
     ANIMATION_RUNNER_CLIMB_RIGHT,
@@ -34,10 +36,12 @@ enum animation_t {
     ANIMATION_RUNNER_RIGHT,
     ANIMATION_RUNNER_UPDOWN,
     ANIMATION_SOLID,
+    // Keep it last.
+    ANIMATION_SIZE,
 };
 
 struct sprite {
-    SDL_Texture *texture;
+    enum texture texture;
     int x;
     int y;
     int w;
@@ -47,15 +51,24 @@ struct sprite {
     int frames;
 };
 
+/*
+ * Animation playback position. Sprites of the animation are shared by all
+ * animations of the same type, so animation itself is just a plain 3 bytes
+ * cursor and can be copied freely.
+ */
 struct animation {
-    struct sprite **sprites;
-    struct sprite **cur;
-    int frame;
+    // Animation type, enum animation_t.
+    uint8_t type;
+    // Index of the current sprite.
+    uint8_t cur;
+    // Number of frames to keep showing current sprite for.
+    uint8_t frame;
 };
 
-struct animation *animation_init(enum animation_t t);
-void animation_destroy(struct animation *a);
+void animation_init(struct animation *a, enum animation_t t);
+int animation_length(enum animation_t t);
 bool animation_tick(struct animation *a);
 void animation_reset(struct animation *a);
+struct sprite *animation_sprite(struct animation *a);
 
 #endif /* ANIMATION_H_ */
@@ -0,0 +1,128 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include "arena.h"
+#include "xmalloc.h"
+
+// Arena allocator. Memory is taken from the blocks one after another and
+// released all at once by arena_reset(). Blocks are kept for reuse after
+// reset, so once the arena has grown to the size its owner needs nothing
+// is allocated from the heap anymore.
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct block {
+    struct block *next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+struct arena {
+    struct block *first;
+    // Block memory is taken from at the moment.
+    struct block *cur;
+    // Bytes taken from all blocks since the last reset and the maximum
+    // of it ever.
+    size_t used;
+    size_t high;
+};
+
+static struct block *block_init(size_t size)
+{
+    struct block *b = xmalloc(sizeof(struct block) + size);
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+
+    return b;
+}
+
+/*
+ * Create arena with the first block of size bytes. Arena grows by blocks
+ * of at least this size when it is exhausted.
+ * It is caller's responsibility to destroy returned arena.
+ */
+struct arena *arena_init(size_t size)
+{
+    struct arena *a = xmalloc(sizeof(struct arena));
+    a->first = block_init(size);
+    a->cur = a->first;
+    a->used = 0;
+    a->high = 0;
+
+    return a;
+}
+
+void arena_destroy(struct arena *a)
+{
+    for (struct block *b = a->first; b != NULL;) {
+        struct block *next = b->next;
+        free(b);
+        b = next;
+    }
+    free(a);
+}
+
+/*
+ * Allocate size bytes from arena a, from the heap if a is NULL. Memory
+ * is suitably aligned for any type. Calls die() on error.
+ */
+void *arena_alloc(struct arena *a, size_t size)
+{
+    if (a == NULL) {
+        return xmalloc(size);
+    }
+
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    struct block *b = a->cur;
+    while (b->size - b->used < size) {
+        if (b->next == NULL) {
+            // Blocks emptied by reset are always reused before growing.
+            b->next = block_init(size > a->first->size
+                ? size : a->first->size);
+        }
+        b = b->next;
+        b->used = 0;
+    }
+    a->cur = b;
+
+    void *p = b->data + b->used;
+    b->used += size;
+    a->used += size;
+    if (a->used > a->high) {
+        a->high = a->used;
+    }
+
+    return p;
+}
+
+/*
+ * Free memory allocated by arena_alloc() from arena a. Memory taken from
+ * an arena is only released by arena_reset(), so this only frees memory
+ * taken from the heap.
+ */
+void arena_free(struct arena *a, void *p)
+{
+    if (a == NULL) {
+        free(p);
+    }
+}
+
+/*
+ * Release all memory allocated from the arena at once.
+ */
+void arena_reset(struct arena *a)
+{
+    a->cur = a->first;
+    a->cur->used = 0;
+    a->used = 0;
+}
+
+/*
+ * Return high-water mark of the arena: maximum number of bytes allocated
+ * from it between resets.
+ */
+size_t arena_high(struct arena *a)
+{
+    return a->high;
+}
@@ -0,0 +1,15 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+struct arena;
+
+struct arena *arena_init(size_t size);
+void arena_destroy(struct arena *a);
+void *arena_alloc(struct arena *a, size_t size);
+void arena_free(struct arena *a, void *p);
+void arena_reset(struct arena *a);
+size_t arena_high(struct arena *a);
+
+#endif /* ARENA_H_ */
@@ -0,0 +1,418 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ai.h"
+#include "arena.h"
+#include "exit.h"
+#include "file.h"
+#include "game.h"
+#include "key.h"
+#include "level.h"
+#include "pool.h"
+#include "replay.h"
+#include "xmalloc.h"
+
+// Batch game simulator. Runs jobs listed in the manifest file on all CPUs
+// and streams per-job results into the output file.
+//
+// Manifest contains a job per line: level number, RNG seed and path to the
+// keys trace file (see key_script()), or just a path to the replay file
+// which has level and seed stored inside. Empty lines and lines starting
+// with # are ignored.
+//
+//     1 42 traces/001.keys
+//     sessions/0001.lrr
+//
+// Job is simulated until the game is over or ticks limit is reached. When
+// trace is over no keys are pressed. When level is won and trace still has
+// keys the game continues with the next level like a player's session does,
+// unless it was the last level.
+//
+// Invalid manifest lines, traces and levels fail only their own jobs: the
+// error is reported to stderr and recorded in the job's status. Batch exits
+// with failure status if any job has failed.
+//
+// Output file starts with "LRB1" magic followed by the number of jobs (u32)
+// and a fixed-size record per job in the order jobs are completed. All
+// integers are little-endian.
+//
+//     u32 job    job index in the manifest, starting from 0
+//     u32 ticks  number of simulated game ticks
+//     u64 hash   final game state hash, see game_hash()
+//     u16 gold   number of gold picked up by the runner
+//     u8  won    1 if the level is completed, 0 otherwise
+//     u8  status 0 if the job is done, see enum job_status otherwise
+
+#define DEFAULT_TICKS 100000
+#define MAGIC "LRB1"
+#define RECORD_SIZE 20
+
+// Status of the job stored in its record.
+enum job_status {
+    JOB_OK = 0,
+    // Manifest line is not a valid job.
+    JOB_BAD_LINE = 1,
+    // Trace file can not be read or is not a valid keys trace or replay.
+    JOB_BAD_TRACE = 2,
+    // Level of the job can not be loaded.
+    JOB_BAD_LEVEL = 3,
+};
+
+struct job {
+    int idx;
+    // JOB_BAD_LINE if the manifest line is invalid, JOB_OK otherwise.
+    enum job_status status;
+    // Level and seed, -1 for replay jobs.
+    int level;
+    uint64_t seed;
+    char *trace;
+};
+
+struct batch {
+    struct job *jobs;
+    int njobs;
+    long maxticks;
+    // Options every job's games are played with.
+    struct game_opts opts;
+    FILE *out;
+    char *outname;
+    // Protects output file.
+    pthread_mutex_t lock;
+    atomic_long ticks;
+    atomic_int won;
+    atomic_int failed;
+};
+
+static struct batch batch;
+
+static void usage()
+{
+    fprintf(stderr, "usage: lr-batch [-a ai] [-j threads] [-n ticks] "
+        "-o output manifest\n"
+        "  -a ai       guards AI: scan or flow (default scan)\n"
+        "  -j threads  number of worker threads (default: number of CPUs)\n"
+        "  -n ticks    max number of ticks to simulate per job (default %d)\n"
+        "  -o output   results file\n",
+        DEFAULT_TICKS);
+    exit(EXIT_FAILURE);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void manifest_load(char *fname)
+{
+    size_t len;
+    char *buf = file_read(fname, &len, NULL);
+    int cap = 64;
+
+    batch.jobs = xmalloc(sizeof(struct job) * cap);
+    batch.njobs = 0;
+
+    int lineno = 0;
+    char *save = NULL;
+    for (char *line = strtok_r(buf, "\n", &save); line != NULL;
+         line = strtok_r(NULL, "\n", &save)) {
+        lineno++;
+        while (*line == ' ' || *line == '\t') {
+            line++;
+        }
+        if (*line == '\0' || *line == '#') {
+            continue;
+        }
+
+        int level;
+        unsigned long long seed;
+        char trace[4096];
+        char end[2];
+        enum job_status status = JOB_OK;
+        int n = sscanf(line, "%d %llu %4095s %1s", &level, &seed, trace,
+            end);
+        if (n != 3) {
+            level = -1;
+            seed = 0;
+            if (sscanf(line, "%4095s %1s", trace, end) != 1) {
+                fprintf(stderr, "%s:%d: invalid job\n", fname, lineno);
+                status = JOB_BAD_LINE;
+                trace[0] = '\0';
+            }
+        }
+
+        if (batch.njobs == cap) {
+            cap *= 2;
+            struct job *jobs = xmalloc(sizeof(struct job) * cap);
+            memcpy(jobs, batch.jobs, sizeof(struct job) * batch.njobs);
+            free(batch.jobs);
+            batch.jobs = jobs;
+        }
+        struct job *j = &batch.jobs[batch.njobs];
+        j->idx = batch.njobs;
+        j->status = status;
+        j->level = level;
+        j->seed = seed;
+        j->trace = strdup(trace);
+        batch.njobs++;
+    }
+
+    free(buf);
+}
+
+static void put_u16(unsigned char *b, uint16_t v)
+{
+    b[0] = v;
+    b[1] = v >> 8;
+}
+
+static void put_u32(unsigned char *b, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        b[i] = v >> (i * 8);
+    }
+}
+
+static void put_u64(unsigned char *b, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) {
+        b[i] = v >> (i * 8);
+    }
+}
+
+static void write_out(unsigned char *b, size_t n)
+{
+    pthread_mutex_lock(&batch.lock);
+    if (fwrite(b, 1, n, batch.out) != n) {
+        die("failed to write %s: %s", batch.outname, strerror(errno));
+    }
+    pthread_mutex_unlock(&batch.lock);
+}
+
+/*
+ * Load job's trace. Keys script traces are converted into replays.
+ * Returns NULL and writes error message into err if the trace can not be
+ * loaded.
+ */
+static struct replay *job_trace(struct job *j, char *err, size_t errlen)
+{
+    size_t len;
+    char *buf = file_load(j->trace, &len, err, errlen, NULL);
+    if (buf == NULL) {
+        return NULL;
+    }
+    struct replay *r;
+
+    if (j->level == -1) {
+        r = replay_parse(buf, len);
+        if (r == NULL) {
+            snprintf(err, errlen, "invalid replay %s", j->trace);
+        }
+    } else {
+        enum key *keys;
+        int nkeys = key_script(buf, len, &keys);
+        if (nkeys == -1) {
+            snprintf(err, errlen, "invalid keys trace %s", j->trace);
+            free(buf);
+            return NULL;
+        }
+        r = replay_init(j->level, j->seed);
+        for (int i = 0; i < nkeys; i++) {
+            replay_record(r, keys[i]);
+        }
+        free(keys);
+    }
+    free(buf);
+
+    return r;
+}
+
+// Job's result, see the record format above.
+struct result {
+    long ticks;
+    uint64_t hash;
+    int gold;
+    bool won;
+    enum job_status status;
+};
+
+// Take result of the last game played.
+static void result_take(struct result *r, struct game *game)
+{
+    r->hash = game_hash(game);
+    r->gold = game->runner.ngold;
+    r->won = game->won;
+}
+
+static void job_record(struct job *j, struct result *r)
+{
+    unsigned char rec[RECORD_SIZE];
+    put_u32(rec, j->idx);
+    put_u32(rec + 4, r->ticks);
+    put_u64(rec + 8, r->hash);
+    put_u16(rec + 16, r->gold);
+    rec[18] = r->won;
+    rec[19] = r->status;
+    write_out(rec, RECORD_SIZE);
+
+    atomic_fetch_add(&batch.ticks, r->ticks);
+    if (r->won) {
+        atomic_fetch_add(&batch.won, 1);
+    }
+    if (r->status != JOB_OK) {
+        atomic_fetch_add(&batch.failed, 1);
+    }
+}
+
+static void job_run(void *arg)
+{
+    struct job *j = arg;
+    struct result r = {0, 0, 0, false, j->status};
+    if (r.status != JOB_OK) {
+        job_record(j, &r);
+        return;
+    }
+
+    char err[256];
+    struct replay *trace = job_trace(j, err, sizeof(err));
+    if (trace == NULL) {
+        fprintf(stderr, "job %d: %s\n", j->idx, err);
+        r.status = JOB_BAD_TRACE;
+        job_record(j, &r);
+        return;
+    }
+
+    // Every level of the run is loaded into the same arena, so level
+    // transitions do not touch the heap.
+    struct arena *arena = arena_init(GAME_ARENA_SIZE);
+    struct level *lvl = level_load(trace->level, err, sizeof(err), arena);
+    struct game *game;
+    if (lvl == NULL) {
+        fprintf(stderr, "job %d: %s\n", j->idx, err);
+        r.status = JOB_BAD_LEVEL;
+        goto done;
+    }
+    game = game_init(lvl, trace->seed, &batch.opts, arena);
+
+    while (r.ticks < batch.maxticks) {
+        enum key k;
+        if (!replay_next(trace, &k)) {
+            k = KEY_NONE;
+        }
+        r.ticks++;
+        if (game_tick(game, k)) {
+            // The run is over after the last level.
+            int l = lvl->num + 1;
+            if (!game->won || replay_done(trace) || !level_exists(l)) {
+                break;
+            }
+
+            // Record keeps the won game if the next level fails to load.
+            result_take(&r, game);
+            arena_reset(arena);
+            lvl = level_load(l, err, sizeof(err), arena);
+            if (lvl == NULL) {
+                fprintf(stderr, "job %d: %s\n", j->idx, err);
+                r.status = JOB_BAD_LEVEL;
+                goto done;
+            }
+            game = game_init(lvl, trace->seed, &batch.opts, arena);
+        }
+    }
+    result_take(&r, game);
+
+done:
+    job_record(j, &r);
+    arena_destroy(arena);
+    replay_destroy(trace);
+}
+
+int main(int argc, char **argv)
+{
+    int nthreads = 0;
+    int mode = AI_MODE_SCAN;
+    batch.maxticks = DEFAULT_TICKS;
+    batch.outname = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:j:n:o:")) != -1) {
+        switch (opt) {
+        case 'a':
+            mode = ai_mode_parse(optarg);
+            break;
+        case 'j':
+            nthreads = atoi(optarg);
+            break;
+        case 'n':
+            batch.maxticks = atol(optarg);
+            break;
+        case 'o':
+            batch.outname = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1 || batch.outname == NULL || batch.maxticks <= 0
+        || mode == -1) {
+        usage();
+    }
+    batch.opts.ai_mode = mode;
+    batch.opts.pool = NULL;
+
+    manifest_load(argv[optind]);
+
+    batch.out = fopen(batch.outname, "w");
+    if (batch.out == NULL) {
+        die("failed to open %s: %s", batch.outname, strerror(errno));
+    }
+    pthread_mutex_init(&batch.lock, NULL);
+    atomic_init(&batch.ticks, 0);
+    atomic_init(&batch.won, 0);
+    atomic_init(&batch.failed, 0);
+
+    unsigned char hdr[8];
+    memcpy(hdr, MAGIC, 4);
+    put_u32(hdr + 4, batch.njobs);
+    write_out(hdr, sizeof(hdr));
+
+    double start = now();
+    struct pool *pool = pool_init(nthreads);
+    struct pool_group group;
+    pool_group_init(&group);
+    for (int i = 0; i < batch.njobs; i++) {
+        pool_submit(pool, &group, job_run, &batch.jobs[i]);
+    }
+    pool_wait(pool, &group);
+    double elapsed = now() - start;
+    int workers = pool_size(pool);
+    pool_destroy(pool);
+
+    if (fclose(batch.out) != 0) {
+        die("failed to write %s: %s", batch.outname, strerror(errno));
+    }
+    pthread_mutex_destroy(&batch.lock);
+
+    long ticks = atomic_load(&batch.ticks);
+    fprintf(stderr, "jobs: %d (won %d, failed %d)\n", batch.njobs,
+        atomic_load(&batch.won), atomic_load(&batch.failed));
+    fprintf(stderr, "threads: %d\n", workers);
+    fprintf(stderr, "ticks: %ld\n", ticks);
+    fprintf(stderr, "time: %.3fs\n", elapsed);
+    fprintf(stderr, "ticks/sec: %.0f\n", ticks / elapsed);
+
+    for (int i = 0; i < batch.njobs; i++) {
+        free(batch.jobs[i].trace);
+    }
+    free(batch.jobs);
+
+    return atomic_load(&batch.failed) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,220 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ai.h"
+#include "arena.h"
+#include "exit.h"
+#include "game.h"
+#include "key.h"
+#include "level.h"
+#include "rng.h"
+#include "xmalloc.h"
+
+// Guards AI benchmark. Plays generated maps of growing size and number of
+// guards with the route scan and the flow field AI and reports simulation
+// speed of both, so it is seen from where on the shared flow field pays off.
+//
+// Maps are floors of bricks four rows apart joined by ladders on the solid
+// ground. By default the runner keeps running left and right along his
+// floor, so the flow field is rebuilt every time he steps on another tile.
+// Level is restarted every time the game ends. Maps too small for the
+// number of guards are skipped.
+
+#define DEFAULT_TICKS 20000
+#define DEFAULT_KEYS "rrrrrrrrrrrrrrrrllllllllllllllll"
+
+static const int SIZES[][2] = {
+    {MAP_WIDTH, MAP_HEIGHT},
+    {40, 24},
+    {MAP_MAX_WIDTH, 32},
+    {MAP_MAX_WIDTH, MAP_MAX_HEIGHT},
+};
+static const int GUARDS[] = {1, 4, 16, 64, 128, MAX_GUARDS};
+
+#define NSIZES (int) (sizeof(SIZES) / sizeof(SIZES[0]))
+#define NGUARDS (int) (sizeof(GUARDS) / sizeof(GUARDS[0]))
+
+static void usage()
+{
+    fprintf(stderr, "usage: lr-bench [-n ticks] [-s seed] [-k keys]\n"
+        "  -n ticks  number of game ticks to simulate per run (default %d)\n"
+        "  -s seed   random numbers generator seed (default 1)\n"
+        "  -k keys   keys script, see lr-sim (default \"%s\")\n",
+        DEFAULT_TICKS, DEFAULT_KEYS);
+    exit(EXIT_FAILURE);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Check if x:y is an empty cell standing on the ground.
+static bool level_free(struct level *lvl, int x, int y)
+{
+    enum map_tile_t below = lvl->map[y + 1][x];
+
+    return lvl->map[y][x] == MAP_TILE_EMPTY && (below == MAP_TILE_BRICK
+        || below == MAP_TILE_SOLID || below == MAP_TILE_LADDER);
+}
+
+// Put tile on a random empty cell standing on the ground.
+static void level_put(struct level *lvl, struct rng *rng, enum map_tile_t t)
+{
+    for (;;) {
+        int x = rng_next(rng) % lvl->w;
+        int y = rng_next(rng) % (lvl->h - 1);
+        if (level_free(lvl, x, y)) {
+            lvl->map[y][x] = t;
+            return;
+        }
+    }
+}
+
+// Generate map w tiles wide and h tiles high with nguards guards. Returns
+// NULL if guards take more than half of the floors, the map is too crowded
+// for guards to chase the runner then.
+static struct level *level_generate(int w, int h, int nguards, uint64_t seed)
+{
+    struct rng rng;
+    rng_seed(&rng, seed);
+
+    struct level *lvl = xmalloc(sizeof(struct level));
+    lvl->num = 1;
+    lvl->w = w;
+    lvl->h = h;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            if (y == h - 1) {
+                lvl->map[y][x] = MAP_TILE_SOLID;
+            } else if (y % 4 == 3) {
+                lvl->map[y][x] = MAP_TILE_BRICK;
+            } else {
+                lvl->map[y][x] = MAP_TILE_EMPTY;
+            }
+        }
+    }
+    // Ladders from every floor up through the one above it.
+    for (int y = 3; y < h; y += 4) {
+        for (int i = 0; i < w / 8; i++) {
+            int x = rng_next(&rng) % w;
+            for (int j = y - 4 < 0 ? 0 : y - 4; j < y; j++) {
+                lvl->map[j][x] = MAP_TILE_LADDER;
+            }
+        }
+    }
+
+    int nfree = 0;
+    for (int y = 0; y < h - 1; y++) {
+        for (int x = 0; x < w; x++) {
+            nfree += level_free(lvl, x, y);
+        }
+    }
+    if (nguards + 2 > nfree / 2) {
+        level_destroy(lvl);
+        return NULL;
+    }
+
+    level_put(lvl, &rng, MAP_TILE_RUNNER);
+    level_put(lvl, &rng, MAP_TILE_GOLD);
+    for (int i = 0; i < nguards; i++) {
+        level_put(lvl, &rng, MAP_TILE_GUARD);
+    }
+
+    return lvl;
+}
+
+// Play level for the given number of ticks and return ticks per second.
+static double play(struct level *lvl, enum ai_mode mode, long ticks,
+    uint64_t seed, enum key *keys, int nkeys)
+{
+    struct game_opts opts = {mode, NULL};
+    struct arena *arena = arena_init(GAME_ARENA_SIZE);
+    struct game *game = game_init(lvl, seed, &opts, arena);
+
+    double start = now();
+    for (long i = 0; i < ticks; i++) {
+        if (game_tick(game, keys[i % nkeys])) {
+            arena_reset(arena);
+            game = game_init(lvl, seed, &opts, arena);
+        }
+    }
+    double elapsed = now() - start;
+
+    arena_destroy(arena);
+
+    return ticks / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    long ticks = DEFAULT_TICKS;
+    uint64_t seed = 1;
+    char *script = DEFAULT_KEYS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:k:")) != -1) {
+        switch (opt) {
+        case 'n':
+            ticks = atol(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'k':
+            script = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc || ticks <= 0) {
+        usage();
+    }
+
+    enum key *keys;
+    int nkeys = key_script(script, strlen(script), &keys);
+    if (nkeys <= 0) {
+        die("invalid keys script");
+    }
+
+    printf("%-7s %6s %12s %12s %9s\n", "map", "guards", "scan t/s",
+        "flow t/s", "flow/scan");
+    for (int i = 0; i < NSIZES; i++) {
+        int w = SIZES[i][0];
+        int h = SIZES[i][1];
+        int crossover = -1;
+        for (int j = 0; j < NGUARDS; j++) {
+            struct level *lvl = level_generate(w, h, GUARDS[j], seed);
+            if (lvl == NULL) {
+                continue;
+            }
+            double scan = play(lvl, AI_MODE_SCAN, ticks, seed, keys, nkeys);
+            double flow = play(lvl, AI_MODE_FLOW, ticks, seed, keys, nkeys);
+            level_destroy(lvl);
+
+            if (crossover == -1 && flow >= scan) {
+                crossover = GUARDS[j];
+            }
+            printf("%2dx%-4d %6d %12.0f %12.0f %9.2f\n", w, h, GUARDS[j],
+                scan, flow, flow / scan);
+        }
+        if (crossover == -1) {
+            printf("%dx%d: flow field is slower with all the guards\n",
+                w, h);
+        } else {
+            printf("%dx%d: flow field wins from %d guards\n", w, h,
+                crossover);
+        }
+    }
+
+    free(keys);
+
+    return EXIT_SUCCESS;
+}
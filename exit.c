@@ -1,7 +1,6 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <SDL2/SDL_error.h>
 #include "exit.h"
 
 void die(char *fmt, ...)
@@ -15,11 +14,3 @@ void die(char *fmt, ...)
 
     exit(EXIT_FAILURE);
 }
-
-void die_sdl(char *func)
-{
-    const char *sdl = SDL_GetError();
-    char *buf = NULL;
-    asprintf(&buf, "%s: %s", func, sdl);
-    die(buf);
-}
@@ -0,0 +1,82 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "arena.h"
+#include "exit.h"
+#include "file.h"
+
+/*
+ * Read whole file into memory allocated from arena a, from the heap if a is
+ * NULL. Regular files are read with a single read into a buffer of the
+ * file's size, other files (pipes and such) are read in chunks. Returned
+ * buffer is NUL-terminated.
+ * Returns NULL and writes error message into err if the file can not be
+ * read. It is caller's responsibility to free returned buffer with
+ * arena_free().
+ */
+char *file_load(char *fname, size_t *len, char *err, size_t errlen,
+    struct arena *a)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1) {
+        snprintf(err, errlen, "failed to open %s: %s", fname,
+            strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    size_t cap = 4096;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        // One extra byte for the terminating NUL and one to detect the file
+        // has grown since fstat().
+        cap = st.st_size + 2;
+    }
+    size_t n = 0;
+    char *buf = arena_alloc(a, cap);
+    for (;;) {
+        ssize_t r = read(fd, buf + n, cap - n - 1);
+        if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            snprintf(err, errlen, "failed to read %s: %s", fname,
+                strerror(errno));
+            close(fd);
+            arena_free(a, buf);
+            return NULL;
+        }
+        n += r;
+        if (r == 0) {
+            break;
+        }
+        if (n == cap - 1) {
+            cap *= 2;
+            char *b = arena_alloc(a, cap);
+            memcpy(b, buf, n);
+            arena_free(a, buf);
+            buf = b;
+        }
+    }
+    close(fd);
+    buf[n] = '\0';
+    *len = n;
+
+    return buf;
+}
+
+/*
+ * Read whole file like file_load() does. Calls die() on error.
+ */
+char *file_read(char *fname, size_t *len, struct arena *a)
+{
+    char err[256];
+    char *buf = file_load(fname, len, err, sizeof(err), a);
+    if (buf == NULL) {
+        die("%s", err);
+    }
+
+    return buf;
+}
@@ -0,0 +1,11 @@
+#ifndef FILE_H_
+#define FILE_H_
+
+#include <stddef.h>
+#include "arena.h"
+
+char *file_load(char *fname, size_t *len, char *err, size_t errlen,
+    struct arena *a);
+char *file_read(char *fname, size_t *len, struct arena *a);
+
+#endif /* FILE_H_ */
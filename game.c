@@ -1,162 +1,244 @@
 #include <assert.h>
-#include <SDL2/SDL.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include "ai.h"
 #include "animation.h"
+#include "arena.h"
 #include "exit.h"
 #include "game.h"
 #include "gold.h"
 #include "guard.h"
+#include "key.h"
 #include "keyhole.h"
 #include "level.h"
 #include "phys.h"
-#include "render.h"
 #include "runner.h"
-#include "texture.h"
 #include "tile.h"
-#include "xmalloc.h"
 
 // TODO: Rename to something like MOVE_DX/MOVE_DY.
 //       Move into the place it can be included by ai.h too?
 #define RUNNER_DX 8
 #define RUNNER_DY 9
 
-static struct map_tile *map_tile_init(enum map_tile_t t, enum animation_t a,
-    int row, int col)
+/*
+ * Return animation displayed for the tile of the given base type.
+ */
+enum animation_t map_tile_animation(enum map_tile_t t)
 {
-    struct map_tile *m = xmalloc(sizeof(struct map_tile));
-
-    if (t != MAP_TILE_EMPTY) {
-        m->basea = animation_init(a);
-    } else {
-        m->basea = NULL;
+    switch (t) {
+    case MAP_TILE_BRICK:
+    case MAP_TILE_FALSE:
+        return ANIMATION_BRICK;
+    case MAP_TILE_LADDER:
+        return ANIMATION_LADDER;
+    case MAP_TILE_ROPE:
+        return ANIMATION_ROPE;
+    case MAP_TILE_SOLID:
+        return ANIMATION_SOLID;
+    default:
+        return ANIMATION_NONE;
     }
-    m->cura = m->basea;
-    m->baset = t;
-    m->curt = m->baset;
-    m->x = col * TILE_MAP_WIDTH;
-    m->y = row * TILE_MAP_HEIGHT;
-
-    return m;
 }
 
-static void map_tile_destroy(struct map_tile *t)
+/*
+ * Return bit board of the tile type, MAP_BOARD_SIZE if tiles of this type
+ * never appear on the map.
+ */
+enum map_board map_tile_board(enum map_tile_t t)
 {
-    if (t->cura != t->basea) {
-        animation_destroy(t->cura);
+    switch (t) {
+    case MAP_TILE_BRICK:
+        return MAP_BOARD_BRICK;
+    case MAP_TILE_EMPTY:
+        return MAP_BOARD_EMPTY;
+    case MAP_TILE_FALSE:
+        return MAP_BOARD_FALSE;
+    case MAP_TILE_LADDER:
+        return MAP_BOARD_LADDER;
+    case MAP_TILE_ROPE:
+        return MAP_BOARD_ROPE;
+    case MAP_TILE_SOLID:
+        return MAP_BOARD_SOLID;
+    default:
+        return MAP_BOARD_SIZE;
     }
-    animation_destroy(t->basea);
-    free(t);
 }
 
-static void map_tile_reset(struct map_tile *tile)
+/*
+ * Change tile's current type. All current type changes must go through here
+ * to keep bit boards in sync.
+ */
+static void map_tile_set(struct game *g, int x, int y, enum map_tile_t t)
 {
-    tile->curt = tile->baset;
-    if (tile->cura != NULL && tile->cura != tile->basea) {
-        animation_destroy(tile->cura);
+    uint64_t bit = (uint64_t) 1 << x;
+    uint64_t *boards = map_boards(g, y);
+    uint8_t *curt = map_curt(g, y);
+
+    if (curt[x] != t) {
+        g->map.version++;
     }
-    tile->cura = tile->basea;
-    if (tile->cura != NULL) {
-        animation_reset(tile->cura);
+    for (int i = 0; i < MAP_BOARD_SIZE; i++) {
+        boards[i] &= ~bit;
     }
+    curt[x] = t;
+    enum map_board b = map_tile_board(t);
+    if (b != MAP_BOARD_SIZE) {
+        boards[b] |= bit;
+    }
+    if (t == MAP_TILE_EMPTY && map_baset(g, y)[x] == MAP_TILE_BRICK) {
+        boards[MAP_BOARD_HOLE] |= bit;
+    }
+}
+
+static void map_tile_init(struct game *g, int x, int y, enum map_tile_t t)
+{
+    map_baset(g, y)[x] = t;
+    map_tile_set(g, x, y, t);
+    animation_init(&map_cura(g, y)[x], map_tile_animation(t));
 }
 
-static struct ground_tile *ground_tile_init(int col)
+static void map_tile_reset(struct game *g, int x, int y)
 {
-    struct ground_tile *tl = xmalloc(sizeof(struct ground_tile));
-    tl->a = animation_init(ANIMATION_GROUND);
-    tl->x = col * TILE_GROUND_WIDTH;
-    tl->y = MAP_HEIGHT * TILE_MAP_HEIGHT;
+    enum map_tile_t t = map_baset(g, y)[x];
 
-    return tl;
+    map_tile_set(g, x, y, t);
+    animation_init(&map_cura(g, y)[x], map_tile_animation(t));
 }
 
-static void ground_tile_destroy(struct ground_tile *t)
+/*
+ * Register hole dug at x:y. Holes are stored in the fixed pool, so digging
+ * never allocates. Returns false if all holes are in use.
+ */
+static bool hole_open(struct game *game, int x, int y)
 {
-    animation_destroy(t->a);
-    free(t);
+    if (game->nholes == MAX_HOLES) {
+        return false;
+    }
+    game->holes[game->nholes++] = (struct hole) {x, y, TIMER_NONE};
+
+    return true;
 }
 
-static struct sprite **text_sprites_init(char *s)
+/*
+ * Start refilling hole at x:y when the runner has dug it.
+ */
+static void hole_fill(struct game *game, int x, int y)
 {
-    int n = strlen(s);
-    int escs = 0;
-    for (int i = 0; i < n; i++) {
-        if (s[i] == '\\') {
-            escs++;
+    animation_init(&map_cura(game, y)[x], ANIMATION_HOLE_FILL);
+    for (int i = 0; i < game->nholes; i++) {
+        if (game->holes[i].x == x && game->holes[i].y == y) {
+            // Refill animation is first ticked on the next tick and the
+            // hole is refilled when it ends.
+            game->holes[i].timer = timer_add(&game->timers,
+                animation_length(ANIMATION_HOLE_FILL), TIMER_HOLE_FILL,
+                x, y);
+            return;
         }
     }
+}
 
-    int nsprites = n - escs + 1;
-    struct sprite **sprites = xmalloc(sizeof(struct sprite *) * nsprites);
-    for (int i = 0, j = 0; i < n; i++, j++) {
-        char ch = s[i];
-        int img = 0;
-        if (ch == '\\') {
-            i++;
-            ch = s[i];
-            img = 1;
+/*
+ * Release hole at x:y when it is refilled or digging is rolled back.
+ */
+static void hole_close(struct game *game, int x, int y)
+{
+    for (int i = 0; i < game->nholes; i++) {
+        if (game->holes[i].x == x && game->holes[i].y == y) {
+            game->holes[i] = game->holes[--game->nholes];
+            return;
         }
+    }
+}
 
-        int idx;
-        if (img && ch == MAP_TILE_GOLD) {
-            idx = 40;
-        } else if (img && ch == MAP_TILE_GUARD) {
-            idx = 41;
-        } else if (ch == ' ') {
-            idx = 43;
-        } else if (ch >= 'A' && ch <= 'Z') {
-            idx = 10 + ch - 'A';
-        } else if (ch >= '0' && ch <= '9') {
-            idx = 0 + ch - '0';
-        } else {
-            die("TODO:");
-        }
-        int r = idx / 10;
-        int c = idx % 10;
+static bool empty_tile(struct game *game, int x, int y)
+{
+    if (x < 0 || x >= game->map.w || y < 0 || y >= game->map.h) {
+        return false;
+    }
+
+    uint64_t *b = map_boards(game, y);
+    uint64_t row = b[MAP_BOARD_EMPTY] | b[MAP_BOARD_FALSE];
+
+    return row >> x & 1;
+}
 
-        struct sprite *sp = xmalloc(sizeof(struct sprite));
-        sp->texture = texture_get(TEXTURE_TEXT);
-        sp->x = c * TILE_TEXT_WIDTH;
-        sp->y = r * TILE_TEXT_HEIGHT;
-        sp->w = TILE_TEXT_WIDTH;
-        sp->h = TILE_TEXT_HEIGHT;
-        sprites[j] = sp;
+/*
+ * Return guard at x:y coordinate if there is any. If there are a few of
+ * them the one with the lowest index is returned.
+ */
+struct guard *guard_at_point(struct game *g, int x, int y)
+{
+    if (x < 0 || x >= g->map.w || y < 0 || y >= g->map.h) {
+        return NULL;
     }
-    sprites[nsprites - 1] = NULL;
 
-    return sprites;
+    int i = game_guardi(g, y)[x];
+
+    return i == -1 ? NULL : &game_guards(g)[i];
 }
 
-void text_sprites_destroy(struct sprite **s)
+// Add guard to the occupancy index of its map cell keeping guards of the
+// cell in the order of their indices.
+static void guard_link(struct game *game, struct guard *g)
 {
-    struct sprite **p = s;
-    while (*p != NULL) {
-        free(*p);
-        p++;
+    struct guard *guards = game_guards(game);
+    int i = g - guards;
+    int16_t *head = &game_guardi(game, g->y)[g->x];
+
+    if (*head == -1 || *head > i) {
+        g->next = *head;
+        *head = i;
+        return;
+    }
+
+    struct guard *p = &guards[*head];
+    while (p->next != -1 && p->next < i) {
+        p = &guards[p->next];
     }
-    free(s);
+    g->next = p->next;
+    p->next = i;
 }
 
-static bool empty_tile(struct game *game, int x, int y)
+// Remove guard from the occupancy index of its map cell.
+static void guard_unlink(struct game *game, struct guard *g)
 {
-    return is_tile(game, x, y, MAP_TILE_EMPTY)
-        || is_tile(game, x, y, MAP_TILE_FALSE);
+    struct guard *guards = game_guards(game);
+    int i = g - guards;
+    int16_t *head = &game_guardi(game, g->y)[g->x];
+
+    if (*head == i) {
+        *head = g->next;
+        return;
+    }
+
+    struct guard *p = &guards[*head];
+    while (p->next != i) {
+        p = &guards[p->next];
+    }
+    p->next = g->next;
 }
 
-struct guard *guard_at_point(struct game *g, int x, int y)
+/*
+ * Move guard to the map cell x:y. Guards' positions must be changed only
+ * through here to keep occupancy index in sync.
+ */
+void guard_move(struct game *game, struct guard *g, int x, int y)
 {
-    for (int i = 0; i < g->nguards; i++) {
-        if (g->guards[i]->x == x && g->guards[i]->y == y) {
-            return g->guards[i];
-        }
+    if (g->x == x && g->y == y) {
+        return;
     }
 
-    return NULL;
+    guard_unlink(game, g);
+    g->x = x;
+    g->y = y;
+    guard_link(game, g);
 }
 
-static void runner_tick(struct game *game, int key)
+static void runner_tick(struct game *game, enum key key)
 {
-    struct runner *runner = game->runner;
+    struct runner *runner = &game->runner;
     enum runner_state state = runner->state;
     bool move = false;
     int x = runner->x;
@@ -165,10 +247,9 @@ static void runner_tick(struct game *game, int key)
     int ty = runner->ty;
 
     if (state == RSTATE_DIG_LEFT || state == RSTATE_DIG_RIGHT) {
-        animation_tick(runner->holelefta);
-        animation_tick(runner->holerighta);
+        animation_tick(&runner->holea);
 
-        bool replay = animation_tick(runner->cura);
+        bool replay = animation_tick(&runner->cura);
         int gx = state == RSTATE_DIG_LEFT ? runner->x - 1 : runner->x + 1;
         int gy = runner->y;
         struct guard *g = guard_at_point(game, gx, gy);
@@ -176,19 +257,22 @@ static void runner_tick(struct game *game, int key)
         int hx = state == RSTATE_DIG_LEFT ? runner->x - 1 : runner->x + 1;
         int hy = runner->y + 1;
 
+        // The hole was checked to be on the map when digging started, see
+        // KEY_DIG_LEFT and KEY_DIG_RIGHT below.
+        assert(hx >= 0 && hx < game->map.w && hy < game->map.h
+            && map_cura(game, hy)[hx].type == ANIMATION_NONE);
+
         // Digging animation reached its end, so it is time to get back
         // to the state runner was before digging.
         if (replay) {
-            assert(game->map[hy][hx]->cura == NULL);
-            game->map[hy][hx]->cura = animation_init(ANIMATION_HOLE_FILL);
+            hole_fill(game, hx, hy);
             state = state == RSTATE_DIG_LEFT ? RSTATE_LEFT : RSTATE_RIGHT;
         } else if (g != NULL) {
             // If runner moves over the hole when it is still in progress
             // we should rollback the digging process.
             if (g->ty > TILE_MAP_HEIGHT / 4) {
-                game->map[hy][hx]->curt = game->map[hy][hx]->baset;
-                assert(game->map[hy][hx]->cura == NULL);
-                game->map[hy][hx]->cura = game->map[hy][hx]->basea;
+                map_tile_reset(game, hx, hy);
+                hole_close(game, hx, hy);
                 state = state == RSTATE_DIG_LEFT ? RSTATE_LEFT : RSTATE_RIGHT;
             }
         }
@@ -232,9 +316,9 @@ static void runner_tick(struct game *game, int key)
             ty = 0;
             state = RSTATE_STOP;
         }
-    } else if (key != 0) {
+    } else if (key != KEY_NONE) {
         switch (key) {
-        case SDLK_LEFT:
+        case KEY_LEFT:
             tx -= RUNNER_DX;
             ty = 0;
             if (tx < -(TILE_MAP_WIDTH / 2)) {
@@ -252,7 +336,7 @@ static void runner_tick(struct game *game, int key)
                 move = true;
             }
             break;
-        case SDLK_RIGHT:
+        case KEY_RIGHT:
             tx += RUNNER_DX;
             ty = 0;
             if (tx > TILE_MAP_WIDTH / 2) {
@@ -270,7 +354,7 @@ static void runner_tick(struct game *game, int key)
                 move = true;
             }
             break;
-        case SDLK_UP:
+        case KEY_UP:
             ty -= RUNNER_DY;
             tx = 0;
             if (ty < -(TILE_MAP_HEIGHT / 2)) {
@@ -285,7 +369,7 @@ static void runner_tick(struct game *game, int key)
                 move = true;
             }
             break;
-        case SDLK_DOWN:
+        case KEY_DOWN:
             ty += RUNNER_DY;
             tx = 0;
             if (ty > TILE_MAP_HEIGHT / 2) {
@@ -309,46 +393,44 @@ static void runner_tick(struct game *game, int key)
                 move = true;
             }
             break;
-        case SDLK_x:
+        case KEY_DIG_RIGHT:
             // TODO: Do not dig if guard is too close.
 
             // Dig only bricks with empty gold-free space above.
             if (is_tile(game, x + 1, y + 1, MAP_TILE_BRICK)
                 && is_tile(game, x + 1, y, MAP_TILE_EMPTY)
-                && gold_get(game, x + 1, y) == NULL) {
+                && gold_get(game, x + 1, y) == -1
+                && hole_open(game, x + 1, y + 1)) {
 
-                struct map_tile *t = game->map[runner->y + 1][runner->x + 1];
-                // Make sure we do not need to free animation.
-                assert(t->cura == t->basea);
-                t->cura = NULL;
-                t->curt = MAP_TILE_EMPTY;
+                animation_init(&map_cura(game, y + 1)[x + 1], ANIMATION_NONE);
+                map_tile_set(game, x + 1, y + 1, MAP_TILE_EMPTY);
                 state = RSTATE_DIG_RIGHT;
-                animation_reset(runner->holerighta);
+                animation_init(&runner->holea, ANIMATION_RUNNER_HOLE_RIGHT);
                 runner->tx = 0;
                 move = true;
             } else {
                 move = false;
             }
             break;
-        case SDLK_z:
+        case KEY_DIG_LEFT:
             // Dig only bricks with empty space above.
             if (is_tile(game, x - 1, y + 1, MAP_TILE_BRICK)
                 && is_tile(game, x - 1, y, MAP_TILE_EMPTY)
-                && gold_get(game, x - 1, y) == NULL) {
+                && gold_get(game, x - 1, y) == -1
+                && hole_open(game, x - 1, y + 1)) {
 
-                struct map_tile *t = game->map[runner->y + 1][runner->x - 1];
-                // Make sure we do not need to free animation.
-                assert(t->cura == t->basea);
-                t->cura = NULL;
-                t->curt = MAP_TILE_EMPTY;
+                animation_init(&map_cura(game, y + 1)[x - 1], ANIMATION_NONE);
+                map_tile_set(game, x - 1, y + 1, MAP_TILE_EMPTY);
                 state = RSTATE_DIG_LEFT;
-                animation_reset(runner->holelefta);
+                animation_init(&runner->holea, ANIMATION_RUNNER_HOLE_LEFT);
                 runner->tx = 0;
                 move = true;
             } else {
                 move = false;
             }
             break;
+        default:
+            break;
         }
     }
     if (move) {
@@ -356,40 +438,52 @@ static void runner_tick(struct game *game, int key)
         runner->y = y;
         runner->tx = tx;
         runner->ty = ty;
-        animation_tick(runner->cura);
+        animation_tick(&runner->cura);
     }
     if (runner->state != state) {
         // When stopped keep current animation.
         if (state != RSTATE_STOP) {
-            runner->cura = runner_state_animation(runner, state);
-            animation_reset(runner->cura);
+            animation_init(&runner->cura, runner_state_animation(state));
         }
         runner->state = state;
     }
 }
 
+/*
+ * Tick open holes. Static tiles are not animated, so only holes being
+ * refilled are touched, and only the holes whose timers are due change
+ * the map.
+ */
 static void map_tick(struct game *game)
 {
-    for (int i = 0; i < MAP_HEIGHT; i++) {
-        for (int j = 0; j < MAP_WIDTH; j++) {
-            struct map_tile *t = game->map[i][j];
-            if (t != NULL && t->cura != NULL) {
-                bool replay = animation_tick(t->cura);
-                if (replay) {
-                    map_tile_reset(t);
-                }
-            }
+    // Refill timers are started only for holes in the pool, so there is
+    // nothing to do on the most ticks when no hole is open.
+    if (game->nholes == 0) {
+        return;
+    }
+
+    for (int i = 0; i < game->nholes; i++) {
+        struct hole *h = &game->holes[i];
+        struct animation *a = &map_cura(game, h->y)[h->x];
+        if (a->type == ANIMATION_HOLE_FILL) {
+            animation_tick(a);
         }
     }
+
+    int x, y;
+    while (timer_expired(&game->timers, TIMER_HOLE_FILL, &x, &y)) {
+        map_tile_reset(game, x, y);
+        hole_close(game, x, y);
+    }
 }
 
 static void open_hladder(struct game *g)
 {
-    for (int i = 0; i < MAP_HEIGHT; i++) {
-        for (int j = 0; j < MAP_WIDTH; j++) {
-            struct map_tile *t = g->map[i][j];
-            if (t->baset == MAP_TILE_LADDER && t->curt == MAP_TILE_EMPTY) {
-                map_tile_reset(t);
+    for (int i = 0; i < g->map.h; i++) {
+        for (int j = 0; j < g->map.w; j++) {
+            if (map_baset(g, i)[j] == MAP_TILE_LADDER
+                && map_curt(g, i)[j] == MAP_TILE_EMPTY) {
+                map_tile_reset(g, j, i);
             }
         }
     }
@@ -400,11 +494,10 @@ static void open_hladder(struct game *g)
  */
 static void detect_collision(struct game *game)
 {
-    struct runner *r = game->runner;
+    struct runner *r = &game->runner;
 
     // Runner picks up gold.
-    struct gold *g = gold_pickup(game, r->x, r->y, r->tx, r->ty);
-    if (g != NULL) {
+    if (gold_pickup(game, r->x, r->y, r->tx, r->ty) != -1) {
         r->ngold++;
     }
 
@@ -431,220 +524,243 @@ static void detect_collision(struct game *game)
     }
 }
 
-static void runner_render(SDL_Renderer *renderer, struct runner *runner)
+static void game_reset(struct game *game)
 {
-    render(renderer, *(runner->cura->cur),
-            runner->x * TILE_MAP_WIDTH + runner->tx,
-            runner->y * TILE_MAP_HEIGHT + runner->ty);
+    runner_reset(&game->runner);
+    // TODO: Decrement men.
+    // TODO: Reset map: guards, gold, etc. Reset all tiles.
+    // TODO: Reset statistics?
 
-    if (runner->state == RSTATE_DIG_LEFT) {
-        render(renderer, *(runner->holelefta->cur),
-            (runner->x - 1) * TILE_MAP_WIDTH,
-            (runner->y) * TILE_MAP_HEIGHT);
+    for (int i = 0; i < game->map.h; i++) {
+        for (int j = 0; j < game->map.w; j++) {
+            map_tile_reset(game, j, i);
+        }
     }
-    if (runner->state == RSTATE_DIG_RIGHT) {
-        render(renderer, *(runner->holerighta->cur),
-            (runner->x + 1) * TILE_MAP_WIDTH,
-            (runner->y) * TILE_MAP_HEIGHT);
+    for (int i = 0; i < game->nholes; i++) {
+        if (game->holes[i].timer != TIMER_NONE) {
+            timer_cancel(&game->timers, game->holes[i].timer);
+        }
     }
+    game->nholes = 0;
 }
 
-static void guard_render(SDL_Renderer *renderer, struct guard *g)
+// Place an array of n bytes aligned to align after the ones already laid
+// out into size bytes. Returns the array's offset.
+static uint32_t layout_array(size_t *size, size_t n, size_t align)
 {
-    // TODO: Check if it is alive and such.
-    render(renderer, *(g->cura->cur),
-            g->x * TILE_MAP_WIDTH + g->tx,
-            g->y * TILE_MAP_HEIGHT + g->ty);
+    size_t off = (*size + align - 1) / align * align;
+    *size = off + n;
+
+    return off;
 }
 
-static void game_reset(struct game *game)
+/*
+ * Lay out arrays of the map w tiles wide and h tiles high with nguards
+ * guards after the game. Unless game is NULL offsets are stored into it
+ * and its timer wheel is set up on its array. Returns size of the game
+ * together with its arrays.
+ */
+static size_t game_layout(struct game *game, int w, int h, int nguards)
 {
-    runner_reset(game->runner);
-    // TODO: Decrement men.
-    // TODO: Reset map: guards, gold, etc. Reset all tiles.
-    // TODO: Reset statistics?
+    size_t size = offsetof(struct game, data);
+    size_t cells = (size_t) w * h;
+
+    // Widest first, so the arrays are aligned with no gaps.
+    uint32_t boards = layout_array(&size,
+        sizeof(uint64_t) * MAP_BOARD_SIZE * h, alignof(uint64_t));
+    uint32_t walk = layout_array(&size, sizeof(uint64_t) * h,
+        alignof(uint64_t));
+    uint32_t guards = layout_array(&size, sizeof(struct guard) * nguards,
+        alignof(struct guard));
+    uint32_t timers = layout_array(&size,
+        sizeof(struct timer) * (MAX_HOLES + nguards), alignof(struct timer));
+    uint32_t goldm = layout_array(&size, sizeof(uint32_t) * cells,
+        alignof(uint32_t));
+    uint32_t rebornx = layout_array(&size, sizeof(int) * w, alignof(int));
+    uint32_t guardi = layout_array(&size, sizeof(int16_t) * cells,
+        alignof(int16_t));
+    uint32_t cura = layout_array(&size, sizeof(struct animation) * cells,
+        alignof(struct animation));
+    uint32_t curt = layout_array(&size, cells, 1);
+    uint32_t baset = layout_array(&size, cells, 1);
+    uint32_t down = layout_array(&size, cells, 1);
+    uint32_t up = layout_array(&size, cells, 1);
+    uint32_t flow = layout_array(&size, cells, 1);
+    size = layout_array(&size, 0, alignof(struct game));
+
+    if (game != NULL) {
+        game->map.w = w;
+        game->map.h = h;
+        game->map.boards = boards;
+        game->map.cura = cura;
+        game->map.curt = curt;
+        game->map.baset = baset;
+        game->guards = guards;
+        game->guardi = guardi;
+        game->goldm = goldm;
+        game->ai_walk = walk;
+        game->ai_rebornx = rebornx;
+        game->ai_down = down;
+        game->ai_up = up;
+        game->ai_flow = flow;
+        game->size = size;
+        timers_init(&game->timers, game_array(game, timers),
+            MAX_HOLES + nguards);
+    }
+
+    return size;
+}
 
-    for (int i = 0; i < MAP_HEIGHT; i++) {
-        for (int j = 0; j < MAP_WIDTH; j++) {
-            map_tile_reset(game->map[i][j]);
-        }
-    }
+/*
+ * Return size of the game together with its arrays, the number of bytes
+ * game_snapshot() copies.
+ */
+size_t game_size(struct game *game)
+{
+    return game->size;
+}
+
+/*
+ * Return size of the game of the largest map with the most guards.
+ */
+size_t game_max_size()
+{
+    return game_layout(NULL, MAP_MAX_WIDTH, MAP_MAX_HEIGHT, MAX_GUARDS);
 }
 
-struct game *game_init(SDL_Renderer *renderer, struct level *lvl)
+/*
+ * Create game of level lvl played with options opts, with the route scan
+ * one guard by one if opts is NULL. Game is allocated from arena a, from
+ * the heap if a is NULL. Game does not refer to the level, so the level
+ * can be freed right after this call. Pool from the options must outlive
+ * the game.
+ * It is caller's responsibility to free returned object allocated from the
+ * heap.
+ */
+struct game *game_init(struct level *lvl, uint64_t seed,
+    struct game_opts *opts, struct arena *a)
 {
-    struct game *game = xmalloc(sizeof(struct game));
+    int nguards = 0;
+    for (int i = 0; i < lvl->h; i++) {
+        for (int j = 0; j < lvl->w; j++) {
+            nguards += lvl->map[i][j] == MAP_TILE_GUARD;
+        }
+    }
+    if (nguards > MAX_GUARDS) {
+        die("guard limit exceeded");
+    }
+
+    size_t size = game_layout(NULL, lvl->w, lvl->h, nguards);
+    struct game *game = arena_alloc(a, size);
+    // Arrays start zeroed: empty boards and gold index. Guards' index is
+    // empty with all bits set.
+    memset(game->data, 0, size - offsetof(struct game, data));
+    game_layout(game, lvl->w, lvl->h, nguards);
+    memset(game_array(game, game->guardi), 0xff,
+        sizeof(int16_t) * lvl->w * lvl->h);
     game->state = GSTATE_START;
     game->keyhole = 0;
-    game->lvl = lvl;
+    game->level = lvl->num;
     game->lives = 1;
-    game->info_score = NULL;
-    game->info_lives = NULL;
-    game->info_level = NULL;
     game->ngold = 0;
     game->won = false;
-    game->runner = runner_init();
-    game->guards = xmalloc(sizeof(struct guard *) * MAX_GUARDS);
+    runner_init(&game->runner);
     game->nguards = 0;
-
-    for (int i = 0; i < MAP_HEIGHT; i++) {
-        for (int j = 0; j < MAP_WIDTH; j++) {
+    game->nholes = 0;
+    rng_seed(&game->rng, seed);
+    game->map.version = 0;
+    game->phase = opts != NULL ? opts->phase : NULL;
+    game->phase_arg = opts != NULL ? opts->arg : NULL;
+
+    for (int i = 0; i < lvl->h; i++) {
+        for (int j = 0; j < lvl->w; j++) {
             switch (lvl->map[i][j]) {
             case MAP_TILE_BRICK:
-                game->map[i][j] = map_tile_init(MAP_TILE_BRICK,
-                    ANIMATION_BRICK, i, j);
-                break;
             case MAP_TILE_EMPTY:
-                game->map[i][j] = map_tile_init(MAP_TILE_EMPTY, 0, i, j);
-                break;
             case MAP_TILE_FALSE:
-                game->map[i][j] = map_tile_init(MAP_TILE_FALSE,
-                    ANIMATION_BRICK, i, j);
+            case MAP_TILE_LADDER:
+            case MAP_TILE_ROPE:
+            case MAP_TILE_SOLID:
+                map_tile_init(game, j, i, lvl->map[i][j]);
                 break;
             case MAP_TILE_GOLD:
-                game->map[i][j] = map_tile_init(MAP_TILE_EMPTY, 0, i, j);
+                map_tile_init(game, j, i, MAP_TILE_EMPTY);
                 if (game->ngold >= MAX_GOLD) {
                     die("gold limit exceeded");
                 }
-                game->gold[game->ngold++] = gold_init(j, i);
+                gold_init(&game->gold[game->ngold], j, i);
+                game_goldm(game, i)[j] |= (uint32_t) 1 << game->ngold++;
                 break;
             case MAP_TILE_GUARD:
-                game->map[i][j] = map_tile_init(MAP_TILE_EMPTY, 0, i, j);
+                map_tile_init(game, j, i, MAP_TILE_EMPTY);
 
-                struct guard *g = guard_init();
+                struct guard *g = &game_guards(game)[game->nguards++];
+                guard_init(g);
                 g->x = j;
                 g->y = i;
-
-                game->nguards++;
-                if (game->nguards > MAX_GUARDS) {
-                    die("guard limit exceeded");
-                }
-                game->guards[game->nguards - 1] = g;
+                guard_link(game, g);
                 break;
             case MAP_TILE_HLADDER:
-                game->map[i][j] = map_tile_init(MAP_TILE_LADDER,
-                    ANIMATION_LADDER, i, j);
-                game->map[i][j]->curt = MAP_TILE_EMPTY;
-                game->map[i][j]->cura = NULL;
-                break;
-            case MAP_TILE_LADDER:
-                game->map[i][j] = map_tile_init(MAP_TILE_LADDER,
-                    ANIMATION_LADDER, i, j);
-                break;
-            case MAP_TILE_ROPE:
-                game->map[i][j] = map_tile_init(MAP_TILE_ROPE,
-                    ANIMATION_ROPE, i, j);
+                map_tile_init(game, j, i, MAP_TILE_LADDER);
+                map_tile_set(game, j, i, MAP_TILE_EMPTY);
+                animation_init(&map_cura(game, i)[j], ANIMATION_NONE);
                 break;
             case MAP_TILE_RUNNER:
-                game->map[i][j] = map_tile_init(MAP_TILE_EMPTY, 0, i, j);
-                game->runner->sx = j;
-                game->runner->sy = i;
-                runner_reset(game->runner);
-                break;
-            case MAP_TILE_SOLID:
-                game->map[i][j] = map_tile_init(MAP_TILE_SOLID,
-                    ANIMATION_SOLID, i, j);
+                map_tile_init(game, j, i, MAP_TILE_EMPTY);
+                game->runner.sx = j;
+                game->runner.sy = i;
+                runner_reset(&game->runner);
                 break;
             default:
                 die("TODO");
             }
         }
     }
-
-    for (int i = 0; i < MAP_WIDTH; i++) {
-        game->ground[i] = ground_tile_init(i);
-    }
+    ai_init(game, opts);
 
     return game;
 }
 
+/*
+ * Free game allocated from the heap. Games allocated from an arena are
+ * freed by arena_reset().
+ */
 void game_destroy(struct game *game)
 {
-    for (int i = 0; i < MAP_HEIGHT; i++) {
-        for (int j = 0; j < MAP_WIDTH; j++) {
-            map_tile_destroy(game->map[i][j]);
-        }
-    }
-
-    for (int i = 0; i < MAP_WIDTH; i++) {
-        ground_tile_destroy(game->ground[i]);
-    }
-
-    // TODO: Free info_score.
-    // TODO: Free info_lives.
-    // TODO: Free info_level.
-
-    runner_destroy(game->runner);
-
-    for (int i = 0; i < game->nguards; i++) {
-        guard_destroy(game->guards[i]);
-    }
-    free(game->guards);
-
     free(game);
 }
 
-void game_render(struct game *game, SDL_Renderer *renderer)
+/*
+ * Save complete game state into snapshot. Snapshot can be any memory of at
+ * least game_size() bytes aligned for struct game.
+ */
+void game_snapshot(struct game *game, struct game *snapshot)
 {
-    for (int i = 0; i < MAP_HEIGHT; i++) {
-        for (int j = 0; j < MAP_WIDTH; j++) {
-            struct map_tile *t = game->map[i][j];
-            if (t != NULL && t->cura != NULL) {
-                render(renderer, *(t->cura->cur), t->x, t->y);
-            }
-        }
-    }
-
-    for (int i = 0; i < game->ngold; i++) {
-        struct gold *g = game->gold[i];
-        if (g->visible) {
-            render(renderer, *(g->animation->cur),
-                g->x * TILE_MAP_WIDTH, g->y * TILE_MAP_HEIGHT);
-        }
-    }
-
-    runner_render(renderer, game->runner);
-
-    for (int i = 0; i < game->nguards; i++) {
-        guard_render(renderer, game->guards[i]);
-    }
-
-    for (int i = 0; i < MAP_WIDTH; i++) {
-        struct ground_tile *t = game->ground[i];
-        render(renderer, *(t->a->cur), t->x, t->y);
-    }
-
-    int col = 0;
-    int infoy = MAP_HEIGHT * TILE_MAP_HEIGHT + TILE_GROUND_HEIGHT;
-    if (game->info_score == NULL) {
-        char buf[16];
-        snprintf(buf, 16, "SCORE%07d", 100500);
-        game->info_score = text_sprites_init(buf);
+    memcpy(snapshot, game, game->size);
+}
 
-    }
-    for (int i = 0; game->info_score[i] != NULL; i++, col++) {
-        render(renderer, game->info_score[i], col * TILE_TEXT_WIDTH, infoy);
-    }
-    if (game->info_lives == NULL) {
-        char buf[16];
-        snprintf(buf, 16, " MEN%03d", game->lives);
-        game->info_lives = text_sprites_init(buf);
-    }
-    for (int i = 0; game->info_lives[i] != NULL; i++, col++) {
-        render(renderer, game->info_lives[i], col * TILE_TEXT_WIDTH, infoy);
-    }
-    if (game->info_level == NULL) {
-        char buf[16];
-        snprintf(buf, 16, " LEVEL%03d", game->lvl->num);
-        game->info_level = text_sprites_init(buf);
-    }
-    for (int i = 0; game->info_level[i] != NULL; i++, col++) {
-        render(renderer, game->info_level[i], col * TILE_TEXT_WIDTH, infoy);
-    }
+/*
+ * Bring game back to the state saved by game_snapshot(). Game must be of the
+ * same level, so it has room for the snapshot.
+ */
+void game_restore(struct game *game, struct game *snapshot)
+{
+    memcpy(game, snapshot, snapshot->size);
+}
 
-    if (game->state == GSTATE_START || game->state == GSTATE_END) {
-        keyhole_render(renderer, (int) game->keyhole);
-    }
+// Run game's tick calling the phase hook at the end of every phase, see
+// struct game_opts. Must do exactly what game_tick() does without the hook.
+static void game_run_phases(struct game *game, enum key key)
+{
+    timers_tick(&game->timers);
+    map_tick(game);
+    game->phase(game->phase_arg, GAME_PHASE_MAP);
+    runner_tick(game, key);
+    game->phase(game->phase_arg, GAME_PHASE_RUNNER);
+    ai_tick(game);
+    game->phase(game->phase_arg, GAME_PHASE_AI);
+    detect_collision(game);
+    game->phase(game->phase_arg, GAME_PHASE_COLLISION);
 }
 
 /*
@@ -653,12 +769,12 @@ void game_render(struct game *game, SDL_Renderer *renderer)
  * Returns ture if game is finished. Game result is stored in `game->won`
  * flag.
  */
-bool game_tick(struct game *game, int key)
+bool game_tick(struct game *game, enum key key)
 {
     switch (game->state) {
     case GSTATE_END:
         if (game->keyhole > 0) {
-            if (key != 0) {
+            if (key != KEY_NONE) {
                 game->keyhole = 0;
             } else {
                 game->keyhole -= KH_SPEED;
@@ -667,7 +783,6 @@ bool game_tick(struct game *game, int key)
             return true;
         } else {
             game->lives--;
-            game->info_lives = NULL; // TODO: Free memory / reset.
             if (game->lives > 0) {
                 game_reset(game);
                 game->state = GSTATE_START;
@@ -678,16 +793,21 @@ bool game_tick(struct game *game, int key)
         break;
     case GSTATE_START:
         if (game->keyhole < KH_MAX_RADIUS) {
-            if (key != 0) {
+            if (key != KEY_NONE) {
                 game->keyhole = KH_MAX_RADIUS;
             } else {
                 game->keyhole += KH_SPEED;
             }
-        } else if (key != 0) {
+        } else if (key != KEY_NONE) {
             game->state = GSTATE_RUN;
         }
         break;
     case GSTATE_RUN:
+        if (game->phase != NULL) {
+            game_run_phases(game, key);
+            break;
+        }
+        timers_tick(&game->timers);
         map_tick(game);
         runner_tick(game, key);
         ai_tick(game);
@@ -700,14 +820,152 @@ bool game_tick(struct game *game, int key)
     return false;
 }
 
-void game_discard_gold(struct game *game, struct gold *gold)
+static uint64_t hash_int(uint64_t h, int64_t v)
+{
+    // FNV-1a over little-endian bytes of the value.
+    for (int i = 0; i < 8; i++) {
+        h ^= (v >> (i * 8)) & 0xff;
+        h *= 0x100000001b3;
+    }
+
+    return h;
+}
+
+static uint64_t hash_animation(uint64_t h, struct animation *a)
+{
+    h = hash_int(h, a->type);
+    h = hash_int(h, a->cur);
+    h = hash_int(h, a->frame);
+
+    return h;
+}
+
+static uint64_t hash_timers(uint64_t h, struct timers *w)
+{
+    // Timers are hashed by the ticks left, slots in the order they expire.
+    for (int i = 0; i < TIMER_SLOTS; i++) {
+        int id = w->slots[(w->now + i) % TIMER_SLOTS];
+        for (; id != TIMER_NONE; id = timer_get(w, id)->next) {
+            struct timer *t = timer_get(w, id);
+            h = hash_int(h, t->due - w->now);
+            h = hash_int(h, t->type);
+            h = hash_int(h, t->x);
+            h = hash_int(h, t->y);
+        }
+    }
+
+    return h;
+}
+
+/*
+ * Return hash of the game simulation state. Games with equal hashes are
+ * going to play the same given the same keys. Hashed are game's state,
+ * lives, RNG, map tiles and their animations, runner, guards, gold, open
+ * holes, pending timers and guards' AI mode, move policy position and
+ * reborn columns.
+ * Purely cosmetic animations and AI caches computed from the rest of the
+ * state are skipped.
+ */
+uint64_t game_hash(struct game *game)
 {
+    uint64_t h = 0xcbf29ce484222325;
+
+    h = hash_int(h, game->state);
+    h = hash_int(h, (int64_t) (game->keyhole * 1000));
+    h = hash_int(h, game->lives);
+    h = hash_int(h, game->won);
+    h = hash_int(h, game->rng.s);
+
+    for (int i = 0; i < game->map.h; i++) {
+        for (int j = 0; j < game->map.w; j++) {
+            struct animation *a = &map_cura(game, i)[j];
+            h = hash_int(h, map_curt(game, i)[j]);
+            if (a->type == ANIMATION_NONE) {
+                h = hash_int(h, -1);
+            } else {
+                h = hash_animation(h, a);
+            }
+        }
+    }
+
+    struct runner *r = &game->runner;
+    h = hash_int(h, r->x);
+    h = hash_int(h, r->y);
+    h = hash_int(h, r->tx);
+    h = hash_int(h, r->ty);
+    h = hash_int(h, r->state);
+    h = hash_int(h, r->ngold);
+    h = hash_animation(h, &r->cura);
+
+    h = hash_int(h, game->nguards);
+    for (int i = 0; i < game->nguards; i++) {
+        struct guard *g = &game_guards(game)[i];
+        h = hash_int(h, g->x);
+        h = hash_int(h, g->y);
+        h = hash_int(h, g->tx);
+        h = hash_int(h, g->ty);
+        h = hash_int(h, g->state);
+        h = hash_int(h, g->hole);
+        h = hash_int(h, g->holey);
+        h = hash_int(h, g->goldholds);
+        h = hash_int(h, g->gold);
+        // Only trap and reborn animations' timing affects gameplay.
+        if (g->state == GSTATE_TRAP_LEFT || g->state == GSTATE_TRAP_RIGHT
+            || g->state == GSTATE_REBORN) {
+            h = hash_animation(h, &g->cura);
+        }
+    }
+
+    h = hash_int(h, game->ngold);
     for (int i = 0; i < game->ngold; i++) {
-        if (game->gold[i] == gold) {
-            gold_destroy(game->gold[i]);
-            game->gold[i] = game->gold[game->ngold - 1];
-            game->ngold--;
-            break;
+        struct gold *g = &game->gold[i];
+        h = hash_int(h, g->x);
+        h = hash_int(h, g->y);
+        h = hash_int(h, g->visible);
+    }
+
+    h = hash_int(h, game->nholes);
+    for (int i = 0; i < game->nholes; i++) {
+        h = hash_int(h, game->holes[i].x);
+        h = hash_int(h, game->holes[i].y);
+    }
+    h = hash_timers(h, &game->timers);
+
+    h = hash_int(h, game->ai_mode);
+    h = hash_int(h, game->ai_imoves);
+    h = hash_int(h, game->ai_iguard);
+    // Only the columns left to reborn at matter, the rest are not even
+    // shuffled yet on a new game.
+    h = hash_int(h, game->ai_irebornx);
+    int *rebornx = game_array(game, game->ai_rebornx);
+    for (int i = game->ai_irebornx; i < game->map.w; i++) {
+        h = hash_int(h, rebornx[i]);
+    }
+
+    return h;
+}
+
+/*
+ * Remove gold from the game. The last gold takes its place, so guard holding
+ * it is updated with the new index.
+ */
+void game_discard_gold(struct game *game, int gold)
+{
+    int last = game->ngold - 1;
+
+    // Discarded gold is held by a guard and is not in the index, but the
+    // last one takes its index.
+    struct gold *l = &game->gold[last];
+    if (l->visible) {
+        game_goldm(game, l->y)[l->x] &= ~((uint32_t) 1 << last);
+        game_goldm(game, l->y)[l->x] |= (uint32_t) 1 << gold;
+    }
+    game->gold[gold] = game->gold[last];
+    struct guard *guards = game_guards(game);
+    for (int i = 0; i < game->nguards; i++) {
+        if (guards[i].gold == last) {
+            guards[i].gold = gold;
         }
     }
+    game->ngold--;
 }
@@ -2,44 +2,132 @@
 #define GAME_H_
 
 #include <stdbool.h>
-#include <SDL2/SDL.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "animation.h"
+#include "arena.h"
+#include "gold.h"
 #include "guard.h"
+#include "key.h"
 #include "level.h"
+#include "rng.h"
 #include "runner.h"
+#include "timer.h"
 
 #define MAX_GOLD 16
-#define MAX_GUARDS 8
+// Level pack stores number of guards in a byte, see pack.c. Guards and
+// their timers are sized by the level, so classic levels do not pay for it.
+#define MAX_GUARDS 255
+// Refill takes about 190 ticks, the runner can not dig more holes in time.
+#define MAX_HOLES 32
+// Arena size enough to load a level from file and create its game without
+// growing the arena, see level_init() and game_init().
+#define GAME_ARENA_SIZE (sizeof(struct level) + game_max_size() + 16384)
+
+// Every map row fits into a bit board word, see struct map.
+_Static_assert(MAP_MAX_WIDTH <= 64, "map row does not fit into uint64_t");
+// Gold on a map cell is stored as a bit mask of its indices, see struct
+// game.
+_Static_assert(MAX_GOLD <= 32, "gold does not fit into uint32_t");
+// Guards' and timers' indices are stored as int16_t.
+_Static_assert(MAX_HOLES + MAX_GUARDS <= INT16_MAX, "too many timers");
+
+// Bit boards of the current tile types, see struct map.
+enum map_board {
+    MAP_BOARD_BRICK,
+    MAP_BOARD_EMPTY,
+    MAP_BOARD_FALSE,
+    // Hole dug by the runner: brick tile which is empty at the moment.
+    MAP_BOARD_HOLE,
+    MAP_BOARD_LADDER,
+    MAP_BOARD_ROPE,
+    MAP_BOARD_SOLID,
+    // Keep it last.
+    MAP_BOARD_SIZE,
+};
 
 /*
- * Game map single tile representation.
+ * Game map. Tiles are stored as structure of arrays, so type checks done by
+ * physics and AI touch only a single byte per tile and a whole map row fits
+ * into a cache line.
+ * Arrays are sized by the map and stored after the game, see struct game.
+ * Only their offsets from the start of the game are stored here, use
+ * map_curt() and friends to get them.
  */
-struct map_tile {
-    // Base animation for this tile, animation displayed by default. E.g. brick.
-    struct animation *basea;
-    // Currently displayed animation on the current map tile. Usually same as
-    // base animation but can be different in some periods of the game. For
-    // example, when runner digs a hole current animatio is set to hole animation
+struct map {
+    int w;
+    int h;
+    // Tiles' current types, uint8_t per tile. Can be different from base
+    // type at some periods during game. For example, when hole is dug
+    // tile's type is changed from brick to empty for period of time when
+    // hole is active. Returned back to base type after that.
+    uint32_t curt;
+    // Tiles' base types, uint8_t per tile.
+    uint32_t baset;
+    // Currently displayed animations, struct animation per tile. Usually it
+    // is the base animation of the tile's base type (e.g. brick) but can be
+    // different in some periods of the game. For example, when runner digs
+    // a hole nothing is displayed and then hole filling animation is shown
     // instead of brick animation.
-    struct animation *cura;
-    // Tile's base type.
-    enum map_tile_t baset;
-    // Tile's current type. Can be different from base type at some periods
-    // during game. For example, when hole is dug tile's type is changed from
-    // brick to empty for period of time when hole is active. Returned back to
-    // base_t after that.
-    enum map_tile_t curt;
-    // X screen coordinate to draw current animation at. It is not always the
-    // same as actual map tile coordinate as some animations (like hole
-    // animation) takes space of two map tiles.
-    int x;
-    // Y screen coordinate to draw current animation at.
-    int y;
+    uint32_t cura;
+    // Bit boards of the current types, MAP_BOARD_SIZE of uint64_t per row:
+    // bit x of the row y is set if tile x:y has the board's type. Kept in
+    // sync with curt, so physics and AI test tiles with a mask and whole
+    // rows with a few bit operations.
+    uint32_t boards;
+    // Incremented on every change of a tile's current type, so results
+    // computed from the map can be cached until it changes.
+    uint32_t version;
 };
 
-struct ground_tile {
-    struct animation *a;
+// Hole dug by the runner which has not been refilled yet.
+struct hole {
     int x;
     int y;
+    // Refill timer, TIMER_NONE while the hole is being dug.
+    int timer;
+};
+
+// Guard AI algorithms, see ai_tick().
+enum ai_mode {
+    // Shared flow field traced from the runner once for all guards. It is
+    // traced again every time the runner steps on another tile, so it
+    // beats the route scan only with many guards: from 64 of them when the
+    // runner keeps running and from a few when he stands, see lr-bench.
+    AI_MODE_FLOW,
+    // Route scan per guard faithful to the original game.
+    AI_MODE_SCAN,
+};
+
+// Phases of a running game's tick in the order they are run, see
+// game_tick().
+enum game_phase {
+    // Guards' moves.
+    GAME_PHASE_AI,
+    // Runner caught by guards and guards standing on each other.
+    GAME_PHASE_COLLISION,
+    // Timers and tiles' animations.
+    GAME_PHASE_MAP,
+    GAME_PHASE_RUNNER,
+    // Keep it last.
+    GAME_PHASE_SIZE,
+};
+
+struct pool;
+
+/*
+ * Options game is played with, see game_init().
+ */
+struct game_opts {
+    enum ai_mode ai_mode;
+    // Pool to look for guards' directions in parallel on, NULL to look for
+    // them one by one. Games play bit-identical whatever the pool is, see
+    // ai_tick(). Games can share the pool.
+    struct pool *pool;
+    // Called with arg at the end of every phase of a running game's tick,
+    // so the phases can be timed, NULL if they are not.
+    void (*phase)(void *arg, enum game_phase phase);
+    void *arg;
 };
 
 enum game_state {
@@ -55,32 +143,144 @@ enum game_state {
 
 /*
  * Game represents single level playing process. It stores gaming state of the
- * current level, like active textures, their location, location of runner,
- * guards, gold and so on.
+ * current level, like location of runner, guards, gold and so on.
+ * Arrays sized by the map and the number of guards follow the game in the
+ * same allocation, so a classic level does not take room of the largest
+ * one. They are referred to
+ * by offsets from the start of the game. Game is plain old data without
+ * any pointers into itself, so the complete simulation state can be saved
+ * and restored with a single memcpy() of its size, see game_snapshot() and
+ * game_restore(). The only pointers are the pool and the phase hook from
+ * the game's options, which are not part of the state and stay the same
+ * across snapshots.
  */
 struct game {
     enum game_state state;
     float keyhole;
-    // TODO: Looks like lvl is not used.
-    struct level *lvl;
+    // Level number.
+    int level;
     int lives;
-    struct map_tile *map[MAP_HEIGHT][MAP_WIDTH];
-    struct ground_tile *ground[MAP_WIDTH];
-    struct sprite **info_score;
-    struct sprite **info_lives;
-    struct sprite **info_level;
-    struct runner *runner;
-    struct guard **guards;
+    struct map map;
+    struct runner runner;
+    // Guards, struct guard per guard on the level.
+    uint32_t guards;
     int nguards;
-    struct gold *gold[MAX_GOLD];
+    struct gold gold[MAX_GOLD];
     int ngold;
+    // Open holes, see hole_open(). Runner can not dig when all of them are
+    // in use.
+    struct hole holes[MAX_HOLES];
+    int nholes;
+    // Pending hole refills, guards' trap escapes and rebirths. Timers tick
+    // only while the game is running. Every open hole and every guard has
+    // at most one pending timer.
+    struct timers timers;
+    // Occupancy index kept in sync with guards' and gold positions, see
+    // guard_move() and gold_drop(). Index of the guard with the lowest
+    // index on the map cell, int16_t per cell, -1 if there is none. Other
+    // guards on the cell follow it, see struct guard. Bit i of the cell's
+    // uint32_t is set if visible gold i is on the cell.
+    uint32_t guardi;
+    uint32_t goldm;
     bool won;
+    // Phase hook, see struct game_opts.
+    void (*phase)(void *arg, enum game_phase phase);
+    void *phase_arg;
+    enum ai_mode ai_mode;
+    // Pool guards' directions are looked for on, see struct game_opts.
+    struct pool *ai_pool;
+    // Guards move policy position, see ai_tick().
+    int ai_imoves;
+    int ai_iguard;
+    // Shuffled map columns to reborn guards at, int per column, see
+    // ai_rand_rebornx().
+    uint32_t ai_rebornx;
+    int ai_irebornx;
+    // Columns guards can walk through on every row without falling,
+    // uint64_t per row, see ai_scan_level().
+    uint32_t ai_walk;
+    // Memoized last rows of the routes traced down and up from every map
+    // cell, int8_t per cell, see ai_scan_down(). Valid for the map version
+    // and the runner's row they were traced for.
+    uint32_t ai_down;
+    uint32_t ai_up;
+    uint32_t ai_scanver;
+    int ai_scanry;
+    // Direction to move from every map cell towards the runner, uint8_t
+    // per cell, see ai_flow_build(). Valid for the map version and the
+    // runner's cell it was built for.
+    uint32_t ai_flow;
+    uint32_t ai_flowver;
+    int ai_flowx;
+    int ai_flowy;
+    // All game randomness comes from this generator, so the same seed and
+    // keys always produce the same game.
+    struct rng rng;
+    // Size of the game together with its arrays, see game_size().
+    uint32_t size;
+    // Arrays sized by the map.
+    uint64_t data[];
 };
 
-struct game *game_init(SDL_Renderer *renderer, struct level *lvl);
-bool game_tick(struct game *game, int key);
-void game_render(struct game *game, SDL_Renderer *renderer);
+/*
+ * Return the game's array at offset off, see struct game.
+ */
+static inline void *game_array(struct game *g, uint32_t off)
+{
+    return (unsigned char *) g + off;
+}
+
+static inline uint8_t *map_curt(struct game *g, int y)
+{
+    return (uint8_t *) game_array(g, g->map.curt) + y * g->map.w;
+}
+
+static inline uint8_t *map_baset(struct game *g, int y)
+{
+    return (uint8_t *) game_array(g, g->map.baset) + y * g->map.w;
+}
+
+static inline struct animation *map_cura(struct game *g, int y)
+{
+    return (struct animation *) game_array(g, g->map.cura) + y * g->map.w;
+}
+
+/*
+ * Return bit boards of the map row y indexed by enum map_board.
+ */
+static inline uint64_t *map_boards(struct game *g, int y)
+{
+    return (uint64_t *) game_array(g, g->map.boards) + y * MAP_BOARD_SIZE;
+}
+
+static inline struct guard *game_guards(struct game *g)
+{
+    return game_array(g, g->guards);
+}
+
+static inline int16_t *game_guardi(struct game *g, int y)
+{
+    return (int16_t *) game_array(g, g->guardi) + y * g->map.w;
+}
+
+static inline uint32_t *game_goldm(struct game *g, int y)
+{
+    return (uint32_t *) game_array(g, g->goldm) + y * g->map.w;
+}
+
+struct game *game_init(struct level *lvl, uint64_t seed,
+    struct game_opts *opts, struct arena *a);
+bool game_tick(struct game *game, enum key key);
+uint64_t game_hash(struct game *game);
+size_t game_size(struct game *game);
+size_t game_max_size();
+void game_snapshot(struct game *game, struct game *snapshot);
+void game_restore(struct game *game, struct game *snapshot);
 void game_destroy(struct game *game);
-void game_discard_gold(struct game *game, struct gold *gold);
+void game_discard_gold(struct game *game, int gold);
+struct guard *guard_at_point(struct game *game, int x, int y);
+void guard_move(struct game *game, struct guard *guard, int x, int y);
+enum animation_t map_tile_animation(enum map_tile_t t);
+enum map_board map_tile_board(enum map_tile_t t);
 
 #endif /* GAME_H_ */
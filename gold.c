@@ -1,23 +1,13 @@
+#include <stdlib.h>
 #include "game.h"
 #include "gold.h"
 #include "tile.h"
-#include "xmalloc.h"
 
-struct gold *gold_init(int x, int y)
+void gold_init(struct gold *g, int x, int y)
 {
-    struct gold *g = xmalloc(sizeof(struct gold));
     g->sx = x;
     g->sy = y;
-    g->animation = animation_init(ANIMATION_GOLD);
     gold_reset(g);
-
-    return g;
-}
-
-void gold_destroy(struct gold *gold)
-{
-    animation_destroy(gold->animation);
-    free(gold);
 }
 
 void gold_reset(struct gold *g)
@@ -27,38 +17,46 @@ void gold_reset(struct gold *g)
     g->visible = true;
 }
 
-struct gold *gold_get(struct game *g, int x, int y)
+/*
+ * Returns index of visible gold at x:y or -1 if there is no gold.
+ */
+int gold_get(struct game *g, int x, int y)
 {
-    for (int i = 0; i < g->ngold; i++) {
-        struct gold *gl = g->gold[i];
-
-        if (gl->visible && gl->x == x && gl->y == y) {
-            return gl;
-        }
+    if (x < 0 || x >= g->map.w || y < 0 || y >= g->map.h) {
+        return -1;
     }
 
-    return NULL;
+    uint32_t m = game_goldm(g, y)[x];
+
+    return m == 0 ? -1 : __builtin_ctz(m);
 }
 
 /*
- * Returns gold at runner's position if can.
+ * Returns index of gold at runner's position if can, -1 otherwise.
  */
-struct gold *gold_pickup(struct game *game, int x, int y, int tx, int ty)
+int gold_pickup(struct game *game, int x, int y, int tx, int ty)
 {
-    struct gold *g = gold_get(game, x, y);
-    if (g != NULL
+    int i = gold_get(game, x, y);
+    if (i != -1
         && abs(0 - tx) <= TILE_MAP_WIDTH / 4
         && abs(0 - ty) <= TILE_MAP_HEIGHT / 4) {
-        g->visible = false;
-        return g;
+        game->gold[i].visible = false;
+        game_goldm(game, y)[x] &= ~((uint32_t) 1 << i);
+        return i;
     }
 
-    return NULL;
+    return -1;
 }
 
-void gold_drop(struct gold *g, int x, int y)
+/*
+ * Drop gold number i held by a guard at x:y.
+ */
+void gold_drop(struct game *game, int i, int x, int y)
 {
+    struct gold *g = &game->gold[i];
+
     g->x = x;
     g->y = y;
     g->visible = true;
+    game_goldm(game, y)[x] |= (uint32_t) 1 << i;
 }
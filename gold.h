@@ -1,7 +1,9 @@
 #ifndef GOLD_H_
 #define GOLD_H_
 
-#include "animation.h"
+#include <stdbool.h>
+
+struct game;
 
 struct gold {
     int sx;
@@ -12,14 +14,12 @@ struct gold {
     // When runner or guard picks the gold up we simply hide it
     // and display it back when it is dropped.
     bool visible;
-    struct animation *animation;
 };
 
-struct gold *gold_init(int x, int y);
-void gold_destroy(struct gold *gold);
+void gold_init(struct gold *gold, int x, int y);
 void gold_reset(struct gold *gold);
-struct gold *gold_get(struct game *g, int x, int y);
-struct gold *gold_pickup(struct game *g, int x, int y, int tx, int ty);
-void gold_drop(struct gold *g, int x, int y);
+int gold_get(struct game *g, int x, int y);
+int gold_pickup(struct game *g, int x, int y, int tx, int ty);
+void gold_drop(struct game *game, int i, int x, int y);
 
 #endif /* GOLD_H_ */
@@ -3,74 +3,40 @@
 #include "phys.h"
 #include "texture.h"
 #include "tile.h"
-#include "xmalloc.h"
 
-struct animation *guard_state_animation(struct guard *g, enum guard_state s)
+enum animation_t guard_state_animation(enum guard_state s)
 {
     switch (s) {
     case GSTATE_CLIMB_LEFT:
-        return g->climblefta;
+        return ANIMATION_GUARD_CLIMB_LEFT;
     case GSTATE_CLIMB_OUT:
-        return g->updowna;
+        return ANIMATION_GUARD_UPDOWN;
     case GSTATE_CLIMB_RIGHT:
-        return g->climbrighta;
+        return ANIMATION_GUARD_CLIMB_RIGHT;
     case GSTATE_FALL_LEFT:
-        return g->falllefta;
+        return ANIMATION_GUARD_FALL_LEFT;
     case GSTATE_FALL_RIGHT:
-        return g->fallrighta;
+        return ANIMATION_GUARD_FALL_RIGHT;
     case GSTATE_LEFT:
-        return g->lefta;
+        return ANIMATION_GUARD_LEFT;
     case GSTATE_REBORN:
-        return g->reborna;
+        return ANIMATION_GUARD_REBORN;
     case GSTATE_RIGHT:
-        return g->righta;
+        return ANIMATION_GUARD_RIGHT;
     case GSTATE_TRAP_LEFT:
-        return g->traplefta;
+        return ANIMATION_GUARD_TRAP_LEFT;
     case GSTATE_TRAP_RIGHT:
-        return g->traprighta;
+        return ANIMATION_GUARD_TRAP_RIGHT;
     case GSTATE_UPDOWN:
-        return g->updowna;
+        return ANIMATION_GUARD_UPDOWN;
     default:
         die("illegal state");
     }
 }
 
-struct guard *guard_init()
+void guard_init(struct guard *g)
 {
-    struct guard *g = xmalloc(sizeof(struct guard));
-    g->x = 0;
-    g->y = 0;
-    g->tx = 0;
-    g->ty = 0;
-    g->lefta = animation_init(ANIMATION_GUARD_LEFT);
-    g->righta = animation_init(ANIMATION_GUARD_RIGHT);
-    g->updowna = animation_init(ANIMATION_GUARD_UPDOWN);
-    g->climblefta = animation_init(ANIMATION_GUARD_CLIMB_LEFT);
-    g->climbrighta = animation_init(ANIMATION_GUARD_CLIMB_RIGHT);
-    g->falllefta = animation_init(ANIMATION_GUARD_FALL_LEFT);
-    g->fallrighta = animation_init(ANIMATION_GUARD_FALL_RIGHT);
-    g->traplefta = animation_init(ANIMATION_GUARD_TRAP_LEFT);
-    g->traprighta = animation_init(ANIMATION_GUARD_TRAP_RIGHT);
-    g->reborna = animation_init(ANIMATION_GUARD_REBORN);
-
     guard_reset(g);
-
-    return g;
-}
-
-void guard_destroy(struct guard *g)
-{
-    animation_destroy(g->lefta);
-    animation_destroy(g->righta);
-    animation_destroy(g->updowna);
-    animation_destroy(g->climblefta);
-    animation_destroy(g->climbrighta);
-    animation_destroy(g->falllefta);
-    animation_destroy(g->fallrighta);
-    animation_destroy(g->traplefta);
-    animation_destroy(g->traprighta);
-    animation_destroy(g->reborna);
-    free(g);
 }
 
 // TODO: Looks like it is used only by guard_init(). Remove it then.
@@ -81,9 +47,12 @@ void guard_reset(struct guard *g)
     g->y = 0;
     g->tx = 0;
     g->ty = 0;
-    g->cura = g->lefta;
+    animation_init(&g->cura, ANIMATION_GUARD_LEFT);
     g->state = GSTATE_LEFT;
+    g->hole = false;
     g->holey = -1;
-    g->gold = NULL;
+    g->gold = -1;
     g->goldholds = 0;
+    g->timer = TIMER_NONE;
+    g->next = -1;
 }
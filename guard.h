@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include "animation.h"
+#include "timer.h"
 
 enum guard_state {
     GSTATE_CLIMB_LEFT,
@@ -20,9 +21,9 @@ enum guard_state {
 };
 
 struct guard {
-    // Current X (0..MAP_WIDTH) position on the map.
+    // Current X (0..map width) position on the map.
     int x;
-    // Current Y (0..MAP_HEIGHT) position on the map.
+    // Current Y (0..map height) position on the map.
     int y;
     // X offset in the current map tile. When guard moves to the second
     // half of the current tile it is transfered to the next tile. To keep
@@ -30,30 +31,8 @@ struct guard {
     int tx;
     // Same as tx but for vertical movement: falls and ladders.
     int ty;
-    // "Move left" animation.
-    struct animation *lefta;
-    // "Move right" animation.
-    struct animation *righta;
-    // Combined "move up" and "move down" animation.
-    struct animation *updowna;
-    // Rope climbing left animation.
-    struct animation *climblefta;
-    // Rope climbing right animation.
-    struct animation *climbrighta;
-    // Looking left guard falling down.
-    struct animation *falllefta;
-    // Looking right guard falling down.
-    struct animation *fallrighta;
-    // Looking left shaking (before getting out from the hole) animation.
-    struct animation *traplefta;
-    // Looking right shaking (before getting out from the hole) animation.
-    struct animation *traprighta;
-    // Guard reborn animation. After reborn animation completed guard moves to
-    // falling right state.
-    struct animation *reborna;
-    // Currently active animation. Points to one of animations like lefta,
-    // righta, updowna, ...
-    struct animation *cura;
+    // Currently active animation.
+    struct animation cura;
     // Guard state defines is it moving left/right, falling, etc.
     enum guard_state state;
     // true if the guard is still climbing out of the hole and still located
@@ -63,17 +42,21 @@ struct guard {
     // To prevent falling into the hole when crossing it horizontally we store Y
     // coordinate of hole we are falling into. -1 when no falling is active.
     int holey;
-    // Gold guard is holding if any.
-    struct gold *gold;
+    // Index of the gold (see struct game) guard is holding, -1 if none.
+    int gold;
     // When guard picks up a gold a random number is generated. As guard moves
     // during the game this counter is decremented every time guard moves to the
     // next map tile. Gold is dropped when 0 is reached.
     int goldholds;
+    // Pending trap escape or rebirth timer, TIMER_NONE if there is none.
+    int timer;
+    // Index of the next guard on the same map cell, -1 if none. Guards on
+    // a cell are kept in the order of their indices, see guard_move().
+    int next;
 };
 
-struct guard *guard_init();
-void guard_destroy(struct guard *g);
+void guard_init(struct guard *g);
 void guard_reset(struct guard *g);
-struct animation *guard_state_animation(struct guard *g, enum guard_state s);
+enum animation_t guard_state_animation(enum guard_state s);
 
 #endif /* GUARD_H_ */
@@ -0,0 +1,63 @@
+#include <ctype.h>
+#include "key.h"
+#include "xmalloc.h"
+
+/*
+ * Keys script representation. Every character stands for a single game tick.
+ */
+static const char KEY_CHARS[] = {
+    [KEY_NONE] = '.',
+    [KEY_ANY] = 'a',
+    [KEY_DIG_LEFT] = 'z',
+    [KEY_DIG_RIGHT] = 'x',
+    [KEY_DOWN] = 'd',
+    [KEY_LEFT] = 'l',
+    [KEY_RIGHT] = 'r',
+    [KEY_UP] = 'u',
+};
+
+/*
+ * Convert script character into a key.
+ * Returns -1 if character is not valid.
+ */
+int key_parse(char c)
+{
+    for (int i = 0; i < (int) sizeof(KEY_CHARS); i++) {
+        if (KEY_CHARS[i] == c) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+char key_char(enum key k)
+{
+    return KEY_CHARS[k];
+}
+
+/*
+ * Parse keys script of len characters. Whitespace is ignored.
+ * Returns number of parsed keys or -1 if script contains invalid character.
+ * It is caller's responsibility to free returned keys array.
+ */
+int key_script(const char *s, size_t len, enum key **keys)
+{
+    enum key *ks = xmalloc(sizeof(enum key) * (len > 0 ? len : 1));
+    int n = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (isspace((unsigned char) s[i])) {
+            continue;
+        }
+        int k = key_parse(s[i]);
+        if (k == -1) {
+            free(ks);
+            return -1;
+        }
+        ks[n++] = k;
+    }
+    *keys = ks;
+
+    return n;
+}
@@ -0,0 +1,27 @@
+#ifndef KEY_H_
+#define KEY_H_
+
+#include <stddef.h>
+
+/*
+ * Player's command for a single game tick. Frontends translate their own
+ * input events into these values before passing them to game_tick().
+ */
+enum key {
+    // No key is pressed. Keep it first (zero).
+    KEY_NONE,
+    // Any other key. Skips keyhole animation and starts the round.
+    KEY_ANY,
+    KEY_DIG_LEFT,
+    KEY_DIG_RIGHT,
+    KEY_DOWN,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_UP,
+};
+
+int key_parse(char c);
+char key_char(enum key k);
+int key_script(const char *s, size_t len, enum key **keys);
+
+#endif /* KEY_H_ */
@@ -1,82 +1,44 @@
+#include <limits.h>
 #include <stdbool.h>
-#include "exit.h"
+#include <SDL2/SDL.h>
 #include "keyhole.h"
+#include "render.h"
 
-static bool valid(int x, int y)
-{
-    return x >= 0 && x < KH_SCREEN_WIDTH
-        && y >= 0 && y < KH_SCREEN_HEIGHT;
-}
+// Number of radii span tables are precomputed for. Keyhole of bigger
+// radius covers the whole screen.
+#define KH_NRADII ((KH_SCREEN_WIDTH + KH_SCREEN_HEIGHT) / 2 + 1)
 
-static void set_pixel(bool scr[KH_SCREEN_WIDTH][KH_SCREEN_HEIGHT],
-    int xc, int yc, int x, int y)
-{
-    if (valid(xc + x, yc + y)) {
-        scr[xc + x][yc + y] = true;
-    }
-    if (valid(xc - x, yc + y)) {
-        scr[xc - x][yc + y] = true;
-    }
-    if (valid(xc + x, yc - y)) {
-        scr[xc + x][yc - y] = true;
-    }
-    if (valid(xc - x, yc - y)) {
-        scr[xc - x][yc - y] = true;
-    }
-    if (valid(xc + y, yc + x)) {
-        scr[xc + y][yc + x] = true;
-    }
-    if (valid(xc - y, yc + x)) {
-        scr[xc - y][yc + x] = true;
-    }
-    if (valid(xc + y, yc - x)) {
-        scr[xc + y][yc - x] = true;
-    }
-    if (valid(xc - y, yc - x)) {
-        scr[xc - y][yc - x] = true;
-    }
-}
+// Visible part of every pseudo-pixels row for every keyhole radius:
+// from spans[r][y][0] to spans[r][y][1] inclusive, empty if the first is
+// bigger than the second. Spans are not clipped by the screen edges.
+// Computed once on the first keyhole render.
+static short spans[KH_NRADII][KH_SCREEN_HEIGHT][2];
+static bool spans_ready = false;
 
-static void floodfill(bool scr[KH_SCREEN_WIDTH][KH_SCREEN_HEIGHT], int x, int y)
+static void span_add(short span[KH_SCREEN_HEIGHT][2], int x, int y)
 {
-    if (x < 0 || x >= KH_SCREEN_WIDTH || y < 0 || y >= KH_SCREEN_HEIGHT) {
+    if (y < 0 || y >= KH_SCREEN_HEIGHT) {
         return;
     }
-    if (scr[x][y]) {
-        return;
+    if (x < span[y][0]) {
+        span[y][0] = x;
     }
-
-    scr[x][y] = true;
-    floodfill(scr, x, y - 1);
-    floodfill(scr, x + 1, y);
-    floodfill(scr, x, y + 1);
-    floodfill(scr, x - 1, y);
-}
-
-static void render_pixel(SDL_Renderer *renderer, int x, int y)
-{
-    SDL_Rect r;
-    r.x = x;
-    r.y = y;
-    r.w = KH_PIXEL;
-    r.h = KH_PIXEL;
-    if (SDL_RenderFillRect(renderer, &r) < 0) {
-        die_sdl("SDL_RenderFillRect");
+    if (x > span[y][1]) {
+        span[y][1] = x;
     }
 }
 
 /*
- * Draw keyhole of radius r (in KH_PIXEL) at the center of the screen.
- * It uses Bresenham’s circle drawing algorithm to draw the circle.
+ * Compute visible rows spans of keyhole of radius r. It uses Bresenham’s
+ * circle drawing algorithm to find the circle's leftmost and rightmost
+ * pixels in every row, everything in between is inside the circle.
  * See: https://www.geeksforgeeks.org/bresenhams-circle-drawing-algorithm
  */
-void keyhole_render(SDL_Renderer *renderer, int r)
+static void spans_init(short span[KH_SCREEN_HEIGHT][2], int r)
 {
-    bool screen[KH_SCREEN_WIDTH][KH_SCREEN_HEIGHT];
-    for (int i = 0; i < KH_SCREEN_WIDTH; i++) {
-        for (int j = 0; j < KH_SCREEN_HEIGHT; j++) {
-            screen[i][j] = false;
-        }
+    for (int i = 0; i < KH_SCREEN_HEIGHT; i++) {
+        span[i][0] = SHRT_MAX;
+        span[i][1] = SHRT_MIN;
     }
 
     int xc = KH_SCREEN_WIDTH / 2;
@@ -85,9 +47,15 @@ void keyhole_render(SDL_Renderer *renderer, int r)
     int y = r;
     int d = 3 - (2 * r);
 
-    // Mark circle pixels as visible.
     do {
-        set_pixel(screen, xc, yc, x, y);
+        span_add(span, xc + x, yc + y);
+        span_add(span, xc - x, yc + y);
+        span_add(span, xc + x, yc - y);
+        span_add(span, xc - x, yc - y);
+        span_add(span, xc + y, yc + x);
+        span_add(span, xc - y, yc + x);
+        span_add(span, xc + y, yc - x);
+        span_add(span, xc - y, yc - x);
 
         x += 1;
         if (d < 0) {
@@ -97,16 +65,49 @@ void keyhole_render(SDL_Renderer *renderer, int r)
             y -= 1;
         }
     } while (x <= y);
+}
 
-    // Fill circle inside with visible pixels.
-    floodfill(screen, xc, yc);
+/*
+ * Draw keyhole of radius r (in KH_PIXEL) at the center of the screen.
+ * Everything outside of the keyhole is covered with at most two rectangles
+ * per pseudo-pixels row drawn with a single call.
+ */
+void keyhole_render(SDL_Renderer *renderer, int r)
+{
+    if (!spans_ready) {
+        for (int i = 0; i < KH_NRADII; i++) {
+            spans_init(spans[i], i);
+        }
+        spans_ready = true;
+    }
+    if (r < 0) {
+        r = 0;
+    } else if (r >= KH_NRADII) {
+        r = KH_NRADII - 1;
+    }
 
-    // And render pseudo-pixels.
-    for (int i = 0; i < KH_SCREEN_WIDTH; i++) {
-        for (int j = 0; j < KH_SCREEN_HEIGHT; j++) {
-            if (!screen[i][j]) {
-                render_pixel(renderer, i * KH_PIXEL, j * KH_PIXEL);
-            }
+    SDL_Rect rects[KH_SCREEN_HEIGHT * 2];
+    int n = 0;
+    for (int y = 0; y < KH_SCREEN_HEIGHT; y++) {
+        int x0 = spans[r][y][0] < 0 ? 0 : spans[r][y][0];
+        int x1 = spans[r][y][1] >= KH_SCREEN_WIDTH
+            ? KH_SCREEN_WIDTH - 1 : spans[r][y][1];
+        if (x0 > x1) {
+            rects[n++] = (SDL_Rect) {0, y * KH_PIXEL,
+                KH_SCREEN_WIDTH * KH_PIXEL, KH_PIXEL};
+            continue;
         }
+        if (x0 > 0) {
+            rects[n++] = (SDL_Rect) {0, y * KH_PIXEL,
+                x0 * KH_PIXEL, KH_PIXEL};
+        }
+        if (x1 < KH_SCREEN_WIDTH - 1) {
+            rects[n++] = (SDL_Rect) {(x1 + 1) * KH_PIXEL, y * KH_PIXEL,
+                (KH_SCREEN_WIDTH - 1 - x1) * KH_PIXEL, KH_PIXEL};
+        }
+    }
+
+    if (n > 0 && SDL_RenderFillRects(renderer, rects, n) < 0) {
+        die_sdl("SDL_RenderFillRects");
     }
 }
@@ -1,7 +1,7 @@
 #ifndef KEYHOLE_H_
 #define KEYHOLE_H_
 
-#include <SDL2/SDL.h>
+#include <math.h>
 
 // TODO:
 #define KH_PIXEL 8
@@ -12,6 +12,8 @@
 #define KH_MAX_RADIUS (sqrtf(KH_SCREEN_WIDTH * KH_SCREEN_WIDTH  \
             + KH_SCREEN_HEIGHT * KH_SCREEN_HEIGHT) / 2)
 
-void keyhole_render(SDL_Renderer *renderer, int r);
+struct SDL_Renderer;
+
+void keyhole_render(struct SDL_Renderer *renderer, int r);
 
 #endif /* KEYHOLE_H_ */
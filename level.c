@@ -1,89 +1,178 @@
-#include <errno.h>
-#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include "arena.h"
 #include "exit.h"
+#include "file.h"
 #include "level.h"
-#include "path.h"
-#include "xmalloc.h"
+#include "pack.h"
 
 #define LEVELS_DIR "./levels"
+#define LEVELS_PACK "./levels.pack"
 
 static const char *TILE_CHARS = "# $0SH-&@X";
 
-/* /\* */
-/*  * Convert character representation as in level-file to struct tile (int). */
-/*  * Returns -1 if character is not valid. */
-/*  *\/ */
-/* static int parse_tile(char c) */
-/* { */
-/*     char *p = strchr(TILE_CHARS, c); */
-/*     if (p == NULL) { */
-/*         return -1; */
-/*     } */
+// Levels pack, NULL if there is no pack and levels are loaded from
+// separate files. Opened once on the first level load.
+static struct pack *pack = NULL;
+static pthread_once_t pack_once = PTHREAD_ONCE_INIT;
 
-/*     return p - TILE_CHARS; */
-/* } */
+/*
+ * Check if character is a valid tile in level file.
+ */
+bool level_is_tile(char c)
+{
+    return c != '\0' && strchr(TILE_CHARS, c) != NULL;
+}
 
 /*
- * Load level from file.
+ * Parse level number n from memory. Every line of the buffer is a map row.
+ * Map is as wide as the longest line and as high as the last non-empty line,
+ * but not smaller than the classic map. Shorter rows and lines are padded
+ * with empty tiles.
+ * Returns NULL and writes error message into err if buffer does not contain
+ * a valid level. Level is allocated from arena a, from the heap if a is NULL.
  * It is caller's responsibility to free returned object.
  */
-struct level *level_init(int n)
+struct level *level_parse(int n, const char *buf, size_t len,
+    char *err, size_t errlen, struct arena *a)
 {
-    char buf[4];
-    snprintf(buf, 4, "%03d", n % 1000);
-    char *fname = path_join(LEVELS_DIR, buf);
-    int f = open(fname, O_RDONLY);
-    if (f == -1) {
-        die("failed to load level %s: %s", fname, strerror(errno));
-    }
-
-    struct level *lvl = xmalloc(sizeof(struct level));
+    struct level *lvl = arena_alloc(a, sizeof(struct level));
     lvl->num = n;
+    lvl->w = MAP_WIDTH;
+    lvl->h = MAP_HEIGHT;
+    for (int row = 0; row < MAP_MAX_HEIGHT; row++) {
+        for (int col = 0; col < MAP_MAX_WIDTH; col++) {
+            lvl->map[row][col] = MAP_TILE_EMPTY;
+        }
+    }
 
-    for (int i = 0; i < MAP_HEIGHT; i++) {
-        char c;
-        ssize_t n;
-        int nl = 0;
-
-        for (int j = 0; j < MAP_WIDTH; j++) {
-            n = read(f, &c, 1);
-            if (n == -1) {
-                die("failed to read %s: %s", fname, strerror(errno));
-            } else if (n == 0 || c == '\n') {
-                for (; j < MAP_WIDTH; j++) {
-                    lvl->map[i][j] = MAP_TILE_EMPTY;
-                }
-                nl = 1;
-                goto eol;
+    size_t i = 0;
+    for (int row = 0; i < len; row++) {
+        int col = 0;
+        for (; i < len && buf[i] != '\n'; i++) {
+            char c = buf[i];
+            if (c == '\r' && i + 1 < len && buf[i + 1] == '\n') {
+                continue;
             }
-
-            char *t = strchr(TILE_CHARS, c);
-            if (t == NULL) {
-                die("invalid level file format: unsupported tile %c", c);
+            if (row == MAP_MAX_HEIGHT) {
+                snprintf(err, errlen, "more than %d lines", MAP_MAX_HEIGHT);
+                goto fail;
             }
-            lvl->map[i][j] = c;
-        }
-    eol:
-        if (!nl) {
-            n = read(f, &c, 1);
-            if (n == -1) {
-                die("failed to read %s: %s", fname, strerror(errno));
+            if (col == MAP_MAX_WIDTH) {
+                snprintf(err, errlen, "line %d: more than %d tiles",
+                    row + 1, MAP_MAX_WIDTH);
+                goto fail;
             }
-            if (n == 0 && i != MAP_HEIGHT - 1) {
-                die("invalid level file format %s", fname);
+            if (!level_is_tile(c)) {
+                snprintf(err, errlen, "line %d column %d: unsupported tile %c",
+                    row + 1, col + 1, c);
+                goto fail;
             }
+            lvl->map[row][col++] = c;
+        }
+        if (col > lvl->w) {
+            lvl->w = col;
+        }
+        if (col > 0 && row >= lvl->h) {
+            lvl->h = row + 1;
+        }
+        if (i < len) {
+            // Skip new line.
+            i++;
         }
     }
 
-    close(f);
-    free(fname);
+    return lvl;
+
+fail:
+    arena_free(a, lvl);
+    return NULL;
+}
+
+static void level_pack_open()
+{
+    if (access(LEVELS_PACK, F_OK) == 0) {
+        pack = pack_open(LEVELS_PACK);
+    }
+}
+
+static void level_fname(char *fname, size_t size, int n)
+{
+    snprintf(fname, size, "%s/%03d", LEVELS_DIR, n % 1000);
+}
+
+/*
+ * Check if there is level n in the levels pack or a file of it.
+ */
+bool level_exists(int n)
+{
+    pthread_once(&pack_once, level_pack_open);
+    if (pack != NULL && pack_has(pack, n)) {
+        return true;
+    }
+
+    char fname[sizeof(LEVELS_DIR) + 8];
+    level_fname(fname, sizeof(fname), n);
+
+    return access(fname, F_OK) == 0;
+}
+
+/*
+ * Load level from the levels pack if there is one, or from the level's own
+ * file otherwise. Level and all temporary memory are allocated from arena a,
+ * so with an arena loading does not touch the heap.
+ * Returns NULL and writes error message into err if the level can not be
+ * loaded. It is caller's responsibility to free returned object allocated
+ * from the heap if a is NULL.
+ */
+struct level *level_load(int n, char *err, size_t errlen, struct arena *a)
+{
+    pthread_once(&pack_once, level_pack_open);
+    if (pack != NULL && pack_has(pack, n)) {
+        return pack_level(pack, n, a);
+    }
+
+    char fname[sizeof(LEVELS_DIR) + 8];
+    level_fname(fname, sizeof(fname), n);
+
+    size_t len;
+    char *buf = file_load(fname, &len, err, errlen, a);
+    if (buf == NULL) {
+        return NULL;
+    }
+    char msg[128];
+    struct level *lvl = level_parse(n, buf, len, msg, sizeof(msg), a);
+    if (lvl == NULL) {
+        snprintf(err, errlen, "invalid level file %s: %s", fname, msg);
+    }
+
+    arena_free(a, buf);
+
+    return lvl;
+}
+
+/*
+ * Load level like level_load() does. Calls die() on error.
+ */
+struct level *level_init(int n, struct arena *a)
+{
+    char err[256];
+    struct level *lvl = level_load(n, err, sizeof(err), a);
+    if (lvl == NULL) {
+        die("%s", err);
+    }
 
     return lvl;
 }
 
+/*
+ * Free level allocated from the heap. Levels allocated from an arena are
+ * freed by arena_reset().
+ */
 void level_destroy(struct level *l)
 {
     free(l);
@@ -92,8 +181,8 @@ void level_destroy(struct level *l)
 // TODO: Just for debugging. Remove it.
 void print_level(struct level *lvl)
 {
-    for (int i = 0; i < MAP_HEIGHT; i++) {
-        for (int j = 0; j < MAP_WIDTH; j++) {
+    for (int i = 0; i < lvl->h; i++) {
+        for (int j = 0; j < lvl->w; j++) {
             printf("%c", lvl->map[i][j]);
         }
         printf("\n");
@@ -1,8 +1,17 @@
 #ifndef LEVEL_H_
 #define LEVEL_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
+
+// Size of the classic map. Smaller maps are padded to it, larger ones are
+// scrolled on the screen of this size.
 #define MAP_WIDTH 28
 #define MAP_HEIGHT 16
+// Largest supported map.
+#define MAP_MAX_WIDTH 64
+#define MAP_MAX_HEIGHT 64
 
 enum map_tile_t {
     MAP_TILE_BRICK = '#',
@@ -19,10 +28,18 @@ enum map_tile_t {
 
 struct level {
     int num;
-    enum map_tile_t map[MAP_HEIGHT][MAP_WIDTH];
+    // Map size, only first h rows and w columns of the map are used.
+    int w;
+    int h;
+    enum map_tile_t map[MAP_MAX_HEIGHT][MAP_MAX_WIDTH];
 };
 
-struct level *level_init(int n);
+bool level_is_tile(char c);
+struct level *level_parse(int n, const char *buf, size_t len,
+    char *err, size_t errlen, struct arena *a);
+bool level_exists(int n);
+struct level *level_load(int n, char *err, size_t errlen, struct arena *a);
+struct level *level_init(int n, struct arena *a);
 void level_destroy(struct level *l);
 
 #endif /* LEVEL_H_ */
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+#include "exit.h"
+#include "level.h"
+
+// Level parser test. Checks maps are sized and padded as documented and
+// invalid levels are rejected with the error pointing at the bad line and
+// column.
+
+struct bad {
+    const char *name;
+    const char *buf;
+    const char *err;
+};
+
+// Buffers too big to be written down, built by main().
+static char tall[(MAP_MAX_HEIGHT + 1) * 2 + 1];
+static char tall_empty[MAP_MAX_HEIGHT + 2];
+static char wide[(MAP_MAX_WIDTH + 2) * 2 + 1];
+static char widest[MAP_MAX_WIDTH + 2];
+
+static struct level *parse(const char *buf, char *err, size_t errlen)
+{
+    return level_parse(7, buf, strlen(buf), err, errlen, NULL);
+}
+
+static void check_size(const char *name, const char *buf, int w, int h)
+{
+    char err[128];
+    struct level *lvl = parse(buf, err, sizeof(err));
+    if (lvl == NULL) {
+        die("%s: %s", name, err);
+    }
+    if (lvl->num != 7 || lvl->w != w || lvl->h != h) {
+        die("%s: level %d is %dx%d instead of %dx%d", name, lvl->num,
+            lvl->w, lvl->h, w, h);
+    }
+    level_destroy(lvl);
+}
+
+int main()
+{
+    for (int i = 0; i < MAP_MAX_HEIGHT + 1; i++) {
+        memcpy(tall + i * 2, "#\n", 2);
+        tall_empty[i] = '\n';
+    }
+    memset(wide, ' ', sizeof(wide) - 1);
+    wide[MAP_MAX_WIDTH + 1] = '\n';
+    memset(widest, '#', MAP_MAX_WIDTH);
+    widest[MAP_MAX_WIDTH] = '\n';
+
+    // Map is as wide as the longest line and as high as the last non-empty
+    // one, never smaller than the classic map.
+    check_size("empty", "", MAP_WIDTH, MAP_HEIGHT);
+    check_size("small", "&\n$#\n", MAP_WIDTH, MAP_HEIGHT);
+    check_size("widest", widest, MAP_MAX_WIDTH, MAP_HEIGHT);
+    // Empty lines beyond the maximum height are fine.
+    check_size("tall empty", tall_empty, MAP_WIDTH, MAP_HEIGHT);
+
+    // Short rows are padded with empty tiles, CR of CRLF is dropped.
+    char err[128];
+    struct level *lvl = parse("H&\r\n\r\n -$\r\n", err, sizeof(err));
+    if (lvl == NULL) {
+        die("crlf: %s", err);
+    }
+    const char *rows[] = {"H&  ", "    ", " -$ "};
+    for (int y = 0; y < 3; y++) {
+        for (int x = 0; x < 4; x++) {
+            if (lvl->map[y][x] != (enum map_tile_t) rows[y][x]) {
+                die("crlf: tile %d:%d is '%c'", x, y, lvl->map[y][x]);
+            }
+        }
+    }
+    if (lvl->map[MAP_MAX_HEIGHT - 1][MAP_MAX_WIDTH - 1] != MAP_TILE_EMPTY) {
+        die("crlf: map is not padded");
+    }
+    level_destroy(lvl);
+
+    struct bad bads[] = {
+        {"tile", "###\n#*#\n", "line 2 column 2: unsupported tile *"},
+        {"lone cr", "#\r#\n", "line 1 column 2: unsupported tile \r"},
+        {"tab", "\t#\n", "line 1 column 1: unsupported tile \t"},
+        {"nul", "#", NULL},
+        {"tall", tall, "more than 64 lines"},
+        {"wide", wide, "line 1: more than 64 tiles"},
+    };
+    int nbads = sizeof(bads) / sizeof(bads[0]);
+
+    for (int i = 0; i < nbads; i++) {
+        struct bad *b = &bads[i];
+        size_t len = strlen(b->buf);
+        const char *want = b->err;
+        if (want == NULL) {
+            // NUL inside the buffer is not a tile.
+            len++;
+            want = "line 1 column 2: unsupported tile ";
+        }
+        lvl = level_parse(7, b->buf, len, err, sizeof(err), NULL);
+        if (lvl != NULL) {
+            die("%s: invalid level is parsed", b->name);
+        }
+        if (strncmp(err, want, strlen(want)) != 0) {
+            die("%s: error \"%s\" instead of \"%s\"", b->name, err, want);
+        }
+    }
+
+    printf("level: %d invalid levels are rejected\n", nbads);
+
+    return 0;
+}
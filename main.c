@@ -2,12 +2,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
+#include "arena.h"
 #include "exit.h"
 #include "game.h"
+#include "key.h"
 #include "level.h"
 #include "path.h"
+#include "pool.h"
+#include "prof.h"
+#include "replay.h"
 #include "texture.h"
 #include "tile.h"
 #include "render.h"
@@ -17,8 +23,13 @@
 #define SCREEN_HEIGHT (MAP_HEIGHT * TILE_MAP_HEIGHT \
         + TILE_GROUND_HEIGHT + TILE_TEXT_HEIGHT)
 
+// Game simulation rate. Game is always ticked at this rate while frames are
+// rendered as often as display allows.
 #define FPS 23
 #define FRAME_TIME (1000.0 / FPS)
+#define TICK_TIME (1.0 / FPS)
+// Max number of ticks to catch up after a stall, e.g. window is dragged.
+#define MAX_CATCHUP 5
 
 
 static void render_texture(SDL_Renderer *renderer, char *texture)
@@ -45,6 +56,29 @@ static void render_texture(SDL_Renderer *renderer, char *texture)
     SDL_DestroyTexture(t);
 }
 
+/*
+ * Translate SDL key code into the game key.
+ */
+static enum key key_map(SDL_Keycode sym)
+{
+    switch (sym) {
+    case SDLK_LEFT:
+        return KEY_LEFT;
+    case SDLK_RIGHT:
+        return KEY_RIGHT;
+    case SDLK_UP:
+        return KEY_UP;
+    case SDLK_DOWN:
+        return KEY_DOWN;
+    case SDLK_z:
+        return KEY_DIG_LEFT;
+    case SDLK_x:
+        return KEY_DIG_RIGHT;
+    default:
+        return KEY_ANY;
+    }
+}
+
 static bool key_wait()
 {
     for (;;) {
@@ -68,9 +102,143 @@ static bool key_wait()
     return false;
 }
 
-int main()
+/*
+ * Next level prepared in the background while the current level's closing
+ * keyhole animation is shown. Level is loaded into its own arena which
+ * becomes the current one when the level starts.
+ */
+struct preload {
+    int level;
+    uint64_t seed;
+    struct game_opts *opts;
+    struct arena *arena;
+    struct level *lvl;
+    struct game *game;
+};
+
+static void preload_run(void *arg)
+{
+    struct preload *p = arg;
+
+    arena_reset(p->arena);
+    p->lvl = level_init(p->level, p->arena);
+    p->game = game_init(p->lvl, p->seed, p->opts, p->arena);
+}
+
+/*
+ * Account the game tick's phase to the profiler, see struct game_opts.
+ */
+static void prof_game_phase(void *arg, enum game_phase p)
+{
+    static const enum prof_phase phases[GAME_PHASE_SIZE] = {
+        [GAME_PHASE_AI] = PROF_AI_TICK,
+        [GAME_PHASE_COLLISION] = PROF_COLLISION,
+        [GAME_PHASE_MAP] = PROF_MAP_TICK,
+        [GAME_PHASE_RUNNER] = PROF_RUNNER_TICK,
+    };
+
+    prof_lap(phases[p]);
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: loderunner [-r replay] [-p replay [-f]] "
+        "[-t csv]\n"
+        "  -r replay  record game session into replay file\n"
+        "  -p replay  play recorded game session back\n"
+        "  -f         play back as fast as possible without rendering\n"
+        "  -t csv     write per-frame phase times into csv file\n"
+        "F3 toggles frame timings overlay.\n");
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * Play recorded session back as fast as possible without rendering and
+ * print its result.
+ */
+static void replay_fast(struct replay *r)
 {
-    srandom(time(NULL));
+    struct arena *arena = arena_init(GAME_ARENA_SIZE);
+    struct level *lvl = level_init(r->level, arena);
+    struct game *game = game_init(lvl, r->seed, NULL, arena);
+    long ticks = 0;
+    enum key key;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (replay_next(r, &key)) {
+        ticks++;
+        if (game_tick(game, key)) {
+            // Next level is played only if the session went on there.
+            if (!game->won || replay_done(r)) {
+                break;
+            }
+            int l = lvl->num + 1;
+
+            arena_reset(arena);
+            lvl = level_init(l, arena);
+            game = game_init(lvl, r->seed, NULL, arena);
+        }
+    }
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec)
+        + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("level: %d\n", lvl->num);
+    printf("ticks: %ld\n", ticks);
+    printf("won: %s\n", game->won ? "yes" : "no");
+    printf("hash: %016llx\n", (unsigned long long) game_hash(game));
+    printf("time: %.3fs (%.0fx real time)\n", elapsed,
+        (double) ticks / FPS / (elapsed > 0 ? elapsed : 1e-9));
+    printf("arena: %zu bytes\n", arena_high(arena));
+
+    arena_destroy(arena);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t seed = time(NULL);
+    int level = 100;
+    char *recname = NULL;
+    struct replay *playback = NULL;
+    bool fast = false;
+    char *csvname = NULL;
+    bool overlay = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:p:ft:")) != -1) {
+        switch (opt) {
+        case 'r':
+            recname = optarg;
+            break;
+        case 'p':
+            playback = replay_load(optarg);
+            break;
+        case 'f':
+            fast = true;
+            break;
+        case 't':
+            csvname = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc || (fast && playback == NULL)
+        || (recname != NULL && playback != NULL)) {
+        usage();
+    }
+    if (playback != NULL) {
+        seed = playback->seed;
+        level = playback->level;
+    }
+    if (fast) {
+        replay_fast(playback);
+        replay_destroy(playback);
+
+        return EXIT_SUCCESS;
+    }
 
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         die("failed to initialize SDL: %s", SDL_GetError());
@@ -89,7 +257,9 @@ int main()
 
     SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
 
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1,
+        SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE
+        | SDL_RENDERER_PRESENTVSYNC);
     if (renderer == NULL) {
         die("failed to initialize SDL renderer: %s", SDL_GetError());
     }
@@ -104,6 +274,7 @@ int main()
     // blit(renderer, brick, 100, 100);
 
     texture_init(renderer);
+    prof_init(csvname);
 
 
     /* struct tile_text *t = xmalloc(sizeof(struct tile_text)); */
@@ -116,22 +287,52 @@ int main()
 
     /* SDL_Event event; */
 
+    struct replay *rec = NULL;
+    struct pool *loader = pool_init(1);
+    struct pool_group loading;
+    struct preload preload;
+    // Tick phases of the games played are timed by the profiler.
+    struct game_opts opts = {AI_MODE_SCAN, NULL, prof_game_phase, NULL};
+    preload.opts = &opts;
+    // Current level and game live in the arena, the next level is preloaded
+    // into the other one, see struct preload. Arenas are swapped on level
+    // change, so levels are loaded without touching the heap.
+    struct arena *arena = arena_init(GAME_ARENA_SIZE);
+    preload.arena = arena_init(GAME_ARENA_SIZE);
+    // Game state before the last tick, frames are interpolated between it
+    // and the current state. Room for any level's game.
+    struct game *prev = xmalloc(game_max_size());
 
     for (;;) {
         SDL_RenderClear(renderer);
         render_texture(renderer, "start.png");
-        if (key_wait()) {
+        if (playback == NULL && key_wait()) {
             break;
         }
 
-        struct level *lvl = level_init(100);
-        struct game *game = game_init(renderer, lvl);
+        // Only the first session is recorded.
+        if (recname != NULL) {
+            rec = replay_init(level, seed);
+        }
+        arena_reset(arena);
+        struct level *lvl = level_init(level, arena);
+        struct game *game = game_init(lvl, seed, &opts, arena);
         bool quit = false;
+        bool preloading = false;
 
-        double delay = 0;
-        int key = 0;
+        game_snapshot(game, prev);
+        Uint64 freq = SDL_GetPerformanceFrequency();
+        Uint64 last = SDL_GetPerformanceCounter();
+        double acc = 0;
+        enum key key = KEY_NONE;
         for (;;) {
-            unsigned long start = SDL_GetTicks64();
+            uint64_t frame = prof_now();
+            Uint64 start = SDL_GetPerformanceCounter();
+            acc += (double) (start - last) / freq;
+            last = start;
+            if (acc > MAX_CATCHUP * TICK_TIME) {
+                acc = MAX_CATCHUP * TICK_TIME;
+            }
 
             SDL_Event event;
             while (SDL_PollEvent(&event)) {
@@ -142,60 +343,100 @@ int main()
                     case SDLK_ESCAPE:
                         quit = true;
                         goto eog;
+                    case SDLK_F3:
+                        overlay = !overlay;
+                        break;
                     default:
-                        key = event.key.keysym.sym;
+                        key = key_map(event.key.keysym.sym);
                         break;
                     }
                     break;
                 case SDL_KEYUP:
-                    if (key == event.key.keysym.sym) {
-                        key = 0;
+                    if (key == key_map(event.key.keysym.sym)) {
+                        key = KEY_NONE;
                     }
                     break;
+                case SDL_RENDER_TARGETS_RESET:
+                    render_reset();
+                    break;
                 case SDL_QUIT:
                     quit = true;
                     goto eog;
                 }
             }
 
-            if (game_tick(game, key)) {
-                if (game->won) {
+            for (; acc >= TICK_TIME; acc -= TICK_TIME) {
+                if (playback != NULL && !replay_next(playback, &key)) {
+                    quit = true;
+                    goto eog;
+                }
+                if (rec != NULL) {
+                    replay_record(rec, key);
+                }
+
+                game_snapshot(game, prev);
+                prof_mark();
+                bool end = game_tick(game, key);
+                // Level is won, load the next one while keyhole is closing.
+                if (game->won && !preloading) {
+                    preload.level = lvl->num + 1;
+                    preload.seed = seed;
+                    pool_group_init(&loading);
+                    pool_submit(loader, &loading, preload_run, &preload);
+                    preloading = true;
+                }
+                if (end) {
+                    if (!game->won) {
+                        goto eog;
+                    }
                     // TODO: Handle last level situation.
                     //       goto eog;
-                    int l = lvl->num + 1;
-
-                    game_destroy(game);
-                    level_destroy(lvl);
-
-                    lvl = level_init(l);
-                    game = game_init(renderer, lvl);
-                } else {
-                    goto eog;
+                    pool_wait(loader, &loading);
+                    preloading = false;
+
+                    struct arena *a = arena;
+                    arena = preload.arena;
+                    preload.arena = a;
+                    lvl = preload.lvl;
+                    game = preload.game;
+                    game_snapshot(game, prev);
                 }
-            } else {
-                SDL_RenderClear(renderer);
-                game_render(game, renderer);
-                // blit(renderer, brick, 100, 100);
-                /* render_tile_text(renderer, t); */
-                SDL_RenderPresent(renderer);
             }
 
-            double left = FRAME_TIME - (SDL_GetTicks64() - start);
-            if (left > 0) {
-                delay += left;
-                long d = (long) delay;
-                delay -= d;
-                SDL_Delay(d);
+            // Keyhole is timed apart from the rest of the game, see
+            // game_render().
+            prof_mark();
+            SDL_RenderClear(renderer);
+            game_render(game, prev, acc / TICK_TIME, renderer);
+            if (overlay) {
+                prof_render(renderer);
+            }
+            prof_mark();
+            SDL_RenderPresent(renderer);
+            prof_lap(PROF_PRESENT);
+            prof_add(PROF_FRAME, frame);
+            prof_frame();
+
+            // Do not spin when display does not limit frame rate.
+            if ((SDL_GetPerformanceCounter() - start) * 1000 < freq) {
+                SDL_Delay(1);
             }
         }
 
     eog:
         bool won = game->won;
 
-        game_destroy(game);
-        level_destroy(lvl);
+        if (preloading) {
+            pool_wait(loader, &loading);
+        }
 
-        if (quit) {
+        if (rec != NULL) {
+            replay_save(rec, recname);
+            replay_destroy(rec);
+            rec = NULL;
+            recname = NULL;
+        }
+        if (quit || playback != NULL) {
             break;
         }
         if (!won) {
@@ -206,7 +447,16 @@ int main()
         }
     }
 
+    pool_destroy(loader);
+    free(prev);
+    arena_destroy(arena);
+    arena_destroy(preload.arena);
+    prof_destroy();
+    render_destroy();
     texture_destroy();
+    if (playback != NULL) {
+        replay_destroy(playback);
+    }
 
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
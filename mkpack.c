@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "exit.h"
+#include "file.h"
+#include "level.h"
+#include "pack.h"
+#include "path.h"
+#include "xmalloc.h"
+
+// Level pack converter. Collects levels stored one per file in the levels
+// directory (001, 002, ... 999) into a single pack file, see pack.c.
+
+#define DEFAULT_DIR "./levels"
+#define MAX_LEVEL 999
+
+static void usage()
+{
+    fprintf(stderr, "usage: lr-pack [-d dir] output\n"
+        "  -d dir  levels directory (default %s)\n",
+        DEFAULT_DIR);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    char *dir = DEFAULT_DIR;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:")) != -1) {
+        switch (opt) {
+        case 'd':
+            dir = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+    }
+
+    struct level **lvls = xmalloc(sizeof(struct level *) * MAX_LEVEL);
+    int nlvls = 0;
+    for (int n = 1; n <= MAX_LEVEL; n++) {
+        char num[8];
+        snprintf(num, sizeof(num), "%03d", n);
+        char *fname = path_join(dir, num);
+        if (access(fname, F_OK) != 0) {
+            free(fname);
+            continue;
+        }
+
+        size_t len;
+        char *buf = file_read(fname, &len, NULL);
+        char err[128];
+        struct level *lvl = level_parse(n, buf, len, err, sizeof(err),
+            NULL);
+        if (lvl == NULL) {
+            die("invalid level file %s: %s", fname, err);
+        }
+        lvls[nlvls++] = lvl;
+        free(buf);
+        free(fname);
+    }
+
+    pack_save(argv[optind], lvls, nlvls);
+    printf("%d levels packed into %s\n", nlvls, argv[optind]);
+
+    for (int i = 0; i < nlvls; i++) {
+        level_destroy(lvls[i]);
+    }
+    free(lvls);
+
+    return EXIT_SUCCESS;
+}
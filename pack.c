@@ -0,0 +1,284 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "arena.h"
+#include "exit.h"
+#include "game.h"
+#include "level.h"
+#include "pack.h"
+#include "xmalloc.h"
+
+// Level pack file format. All integers are little-endian.
+//
+//     "LRPK"    magic
+//     u8        format version
+//     u8        default map width, always classic 28
+//     u8        default map height, always classic 16
+//     u8        reserved, 0
+//     u32       first level number
+//     u32       number of index entries
+//     index...  entry per level number starting from the first one
+//     maps...   width * height tile characters per level, row by row
+//
+// Index entry is 8 bytes:
+//
+//     u32       offset of the level's map from the start of the file,
+//               0 if there is no such level in the pack
+//     u8        number of gold on the level
+//     u8        number of guards on the level
+//     u8        map width, 0 for the default one
+//     u8        map height, 0 for the default one
+//
+// Version 1 packs have only default sized maps and zero instead of the size.
+
+#define PACK_MAGIC "LRPK"
+#define PACK_VERSION 2
+#define PACK_HEADER_SIZE 16
+#define PACK_ENTRY_SIZE 8
+
+// Number of gold and guards on a level are stored in a byte.
+_Static_assert(MAX_GOLD <= UINT8_MAX, "gold does not fit into u8");
+_Static_assert(MAX_GUARDS <= UINT8_MAX, "guards do not fit into u8");
+
+static uint32_t get_u32(const unsigned char *b)
+{
+    return b[0] | b[1] << 8 | b[2] << 16 | (uint32_t) b[3] << 24;
+}
+
+static void put_u32(unsigned char *b, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        b[i] = v >> (i * 8);
+    }
+}
+
+static const unsigned char *pack_entry(struct pack *p, int n)
+{
+    if (n < p->first || n - p->first >= p->count) {
+        return NULL;
+    }
+
+    return p->data + PACK_HEADER_SIZE
+        + (size_t) (n - p->first) * PACK_ENTRY_SIZE;
+}
+
+// Get size of the map of index entry e.
+static void pack_entry_size(const unsigned char *e, int *w, int *h)
+{
+    *w = e[6] != 0 ? e[6] : MAP_WIDTH;
+    *h = e[7] != 0 ? e[7] : MAP_HEIGHT;
+}
+
+/*
+ * Map pack file into memory. All levels are validated once here, so
+ * loading them later can not fail: maps lie after the index within the
+ * file, have supported sizes and tiles, and the numbers of gold and guards
+ * stored in the index match the maps. Calls die() on error.
+ * It is caller's responsibility to close returned pack.
+ */
+struct pack *pack_open(char *fname)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1) {
+        die("failed to open %s: %s", fname, strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        die("failed to stat %s: %s", fname, strerror(errno));
+    }
+    if (st.st_size < PACK_HEADER_SIZE) {
+        die("invalid level pack %s", fname);
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        die("failed to map %s: %s", fname, strerror(errno));
+    }
+    close(fd);
+
+    struct pack *p = xmalloc(sizeof(struct pack));
+    p->data = data;
+    p->size = st.st_size;
+
+    const unsigned char *b = p->data;
+    if (memcmp(b, PACK_MAGIC, 4) != 0 || b[4] < 1 || b[4] > PACK_VERSION
+        || b[5] != MAP_WIDTH || b[6] != MAP_HEIGHT) {
+        die("invalid level pack %s", fname);
+    }
+    uint32_t first = get_u32(b + 8);
+    uint32_t count = get_u32(b + 12);
+    if (first > INT32_MAX || count > (p->size - PACK_HEADER_SIZE)
+        / PACK_ENTRY_SIZE) {
+        die("invalid level pack %s", fname);
+    }
+    p->first = first;
+    p->count = count;
+
+    size_t maps = PACK_HEADER_SIZE + (size_t) p->count * PACK_ENTRY_SIZE;
+    for (int i = 0; i < p->count; i++) {
+        const unsigned char *e = pack_entry(p, p->first + i);
+        uint32_t off = get_u32(e);
+        if (off == 0) {
+            continue;
+        }
+        if (off < maps) {
+            die("invalid level pack %s: level %d overlaps the index",
+                fname, p->first + i);
+        }
+        int w, h;
+        pack_entry_size(e, &w, &h);
+        if (w < MAP_WIDTH || w > MAP_MAX_WIDTH
+            || h < MAP_HEIGHT || h > MAP_MAX_HEIGHT) {
+            die("invalid level pack %s: level %d has unsupported size",
+                fname, p->first + i);
+        }
+        if (off > p->size || p->size - off < (size_t) (w * h)) {
+            die("invalid level pack %s: level %d is out of file",
+                fname, p->first + i);
+        }
+        int ngold = 0;
+        int nguards = 0;
+        for (int j = 0; j < w * h; j++) {
+            char c = p->data[off + j];
+            if (!level_is_tile(c)) {
+                die("invalid level pack %s: level %d has unsupported tile",
+                    fname, p->first + i);
+            }
+            ngold += c == MAP_TILE_GOLD;
+            nguards += c == MAP_TILE_GUARD;
+        }
+        if (ngold != e[4] || nguards != e[5] || ngold > MAX_GOLD
+            || nguards > MAX_GUARDS) {
+            die("invalid level pack %s: level %d has wrong number of gold "
+                "or guards", fname, p->first + i);
+        }
+    }
+
+    return p;
+}
+
+void pack_close(struct pack *p)
+{
+    munmap((void *) p->data, p->size);
+    free(p);
+}
+
+/*
+ * Check if pack contains level number n.
+ */
+bool pack_has(struct pack *p, int n)
+{
+    const unsigned char *e = pack_entry(p, n);
+
+    return e != NULL && get_u32(e) != 0;
+}
+
+/*
+ * Return number of gold on level n, -1 if there is no such level.
+ */
+int pack_gold(struct pack *p, int n)
+{
+    return pack_has(p, n) ? pack_entry(p, n)[4] : -1;
+}
+
+/*
+ * Return number of guards on level n, -1 if there is no such level.
+ */
+int pack_guards(struct pack *p, int n)
+{
+    return pack_has(p, n) ? pack_entry(p, n)[5] : -1;
+}
+
+/*
+ * Load level number n from the pack into arena a, into the heap if a is
+ * NULL. Returns NULL if there is no such level.
+ * It is caller's responsibility to free returned object.
+ */
+struct level *pack_level(struct pack *p, int n, struct arena *a)
+{
+    if (!pack_has(p, n)) {
+        return NULL;
+    }
+
+    const unsigned char *e = pack_entry(p, n);
+    const unsigned char *m = p->data + get_u32(e);
+    struct level *lvl = arena_alloc(a, sizeof(struct level));
+    lvl->num = n;
+    pack_entry_size(e, &lvl->w, &lvl->h);
+    for (int i = 0; i < lvl->h; i++) {
+        for (int j = 0; j < lvl->w; j++) {
+            lvl->map[i][j] = m[i * lvl->w + j];
+        }
+    }
+
+    return lvl;
+}
+
+/*
+ * Write levels into pack file. Levels must be sorted by number without
+ * duplicates. Calls die() on error.
+ */
+void pack_save(char *fname, struct level **lvls, int nlvls)
+{
+    int first = nlvls > 0 ? lvls[0]->num : 0;
+    int count = nlvls > 0 ? lvls[nlvls - 1]->num - first + 1 : 0;
+    size_t size = PACK_HEADER_SIZE + (size_t) count * PACK_ENTRY_SIZE;
+    for (int i = 0; i < nlvls; i++) {
+        size += (size_t) (lvls[i]->w * lvls[i]->h);
+    }
+    if (size > UINT32_MAX) {
+        die("too many levels for a pack");
+    }
+
+    unsigned char *buf = xmalloc(size);
+    memset(buf, 0, size);
+    memcpy(buf, PACK_MAGIC, 4);
+    buf[4] = PACK_VERSION;
+    buf[5] = MAP_WIDTH;
+    buf[6] = MAP_HEIGHT;
+    put_u32(buf + 8, first);
+    put_u32(buf + 12, count);
+
+    size_t off = PACK_HEADER_SIZE + (size_t) count * PACK_ENTRY_SIZE;
+    for (int i = 0; i < nlvls; i++) {
+        struct level *lvl = lvls[i];
+        unsigned char *e = buf + PACK_HEADER_SIZE
+            + (size_t) (lvl->num - first) * PACK_ENTRY_SIZE;
+        int ngold = 0;
+        int nguards = 0;
+        for (int y = 0; y < lvl->h; y++) {
+            for (int x = 0; x < lvl->w; x++) {
+                buf[off + y * lvl->w + x] = lvl->map[y][x];
+                ngold += lvl->map[y][x] == MAP_TILE_GOLD;
+                nguards += lvl->map[y][x] == MAP_TILE_GUARD;
+            }
+        }
+        if (ngold > MAX_GOLD) {
+            die("level %d has more than %d gold", lvl->num, MAX_GOLD);
+        }
+        if (nguards > MAX_GUARDS) {
+            die("level %d has more than %d guards", lvl->num, MAX_GUARDS);
+        }
+        put_u32(e, off);
+        e[4] = ngold;
+        e[5] = nguards;
+        if (lvl->w != MAP_WIDTH || lvl->h != MAP_HEIGHT) {
+            e[6] = lvl->w;
+            e[7] = lvl->h;
+        }
+        off += (size_t) (lvl->w * lvl->h);
+    }
+
+    FILE *f = fopen(fname, "w");
+    if (f == NULL) {
+        die("failed to open %s: %s", fname, strerror(errno));
+    }
+    fwrite(buf, 1, size, f);
+    if (ferror(f) || fclose(f) != 0) {
+        die("failed to write %s: %s", fname, strerror(errno));
+    }
+    free(buf);
+}
@@ -0,0 +1,30 @@
+#ifndef PACK_H_
+#define PACK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "level.h"
+
+/*
+ * Level pack: all levels stored in a single file which is memory-mapped
+ * once, levels are looked up by number in constant time.
+ */
+struct pack {
+    const unsigned char *data;
+    size_t size;
+    // Number of the first level in the pack and number of index entries.
+    int first;
+    int count;
+};
+
+struct pack *pack_open(char *fname);
+void pack_close(struct pack *p);
+bool pack_has(struct pack *p, int n);
+int pack_gold(struct pack *p, int n);
+int pack_guards(struct pack *p, int n);
+struct level *pack_level(struct pack *p, int n, struct arena *a);
+void pack_save(char *fname, struct level **lvls, int nlvls);
+
+#endif /* PACK_H_ */
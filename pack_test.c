@@ -0,0 +1,260 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "exit.h"
+#include "file.h"
+#include "game.h"
+#include "level.h"
+#include "pack.h"
+#include "xmalloc.h"
+
+// Level pack test. Saves classic and large levels into a pack and checks
+// they are loaded back unchanged, then checks corrupted copies of the pack
+// and levels which do not fit into it are rejected.
+
+#define NLEVELS 3
+
+// Offsets into the pack, see pack.c.
+#define HEADER_SIZE 16
+#define ENTRY_SIZE 8
+
+static char fname[] = "/tmp/lr-pack-test-XXXXXX";
+
+static struct level *level_make(int n, int w, int h, int ngold, int nguards)
+{
+    struct level *lvl = xmalloc(sizeof(struct level));
+    lvl->num = n;
+    lvl->w = w;
+    lvl->h = h;
+    for (int y = 0; y < MAP_MAX_HEIGHT; y++) {
+        for (int x = 0; x < MAP_MAX_WIDTH; x++) {
+            enum map_tile_t t = MAP_TILE_EMPTY;
+            if (y == h - 1) {
+                t = MAP_TILE_SOLID;
+            } else if (y % 4 == 3) {
+                t = x % 8 == 1 ? MAP_TILE_LADDER : MAP_TILE_BRICK;
+            }
+            lvl->map[y][x] = y < h && x < w ? t : MAP_TILE_EMPTY;
+        }
+    }
+    lvl->map[h - 2][0] = MAP_TILE_RUNNER;
+    for (int i = 0; i < ngold; i++) {
+        lvl->map[i / w][i % w] = MAP_TILE_GOLD;
+    }
+    for (int i = 0; i < nguards; i++) {
+        lvl->map[4 + i / (w - 1)][1 + i % (w - 1)] = MAP_TILE_GUARD;
+    }
+
+    return lvl;
+}
+
+// Run fn(arg) in a child process and check it dies with the error message
+// containing msg.
+static bool dies(void (*fn)(void *arg), void *arg, const char *msg)
+{
+    int fds[2];
+    if (pipe(fds) == -1) {
+        die("failed to create pipe");
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        die("failed to fork");
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDERR_FILENO);
+        fn(arg);
+        exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+
+    char err[256];
+    size_t n = 0;
+    ssize_t r;
+    while ((r = read(fds[0], err + n, sizeof(err) - n - 1)) > 0) {
+        n += r;
+    }
+    err[n] = '\0';
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE
+        && strstr(err, msg) != NULL;
+}
+
+static void open_run(void *arg)
+{
+    (void) arg;
+    pack_close(pack_open(fname));
+}
+
+static void save_run(void *arg)
+{
+    pack_save(fname, (struct level **) &arg, 1);
+}
+
+static void write_pack(const unsigned char *buf, size_t size)
+{
+    FILE *f = fopen(fname, "w");
+    if (f == NULL || fwrite(buf, 1, size, f) != size || fclose(f) != 0) {
+        die("failed to write %s", fname);
+    }
+}
+
+static void put_u32(unsigned char *b, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        b[i] = v >> (i * 8);
+    }
+}
+
+static void test_round_trip(struct level **lvls)
+{
+    pack_save(fname, lvls, NLEVELS);
+    struct pack *p = pack_open(fname);
+
+    for (int i = 0; i < NLEVELS; i++) {
+        struct level *want = lvls[i];
+        struct level *got = pack_level(p, want->num, NULL);
+        if (got == NULL || got->w != want->w || got->h != want->h) {
+            die("level %d: size differs", want->num);
+        }
+        for (int y = 0; y < want->h; y++) {
+            if (memcmp(got->map[y], want->map[y],
+                    sizeof(enum map_tile_t) * want->w) != 0) {
+                die("level %d: row %d differs", want->num, y);
+            }
+        }
+        level_destroy(got);
+    }
+    if (pack_gold(p, 1) != MAX_GOLD || pack_guards(p, 1) != 5
+        || pack_gold(p, 3) != 1 || pack_guards(p, 3) != MAX_GUARDS) {
+        die("wrong number of gold or guards");
+    }
+    // Levels between and around the saved ones are not in the pack.
+    if (pack_has(p, 0) || pack_has(p, 2) || pack_has(p, 6)
+        || pack_level(p, 2, NULL) != NULL || pack_gold(p, 2) != -1) {
+        die("pack has a level which is not saved");
+    }
+
+    pack_close(p);
+}
+
+static void test_corrupt()
+{
+    size_t size;
+    unsigned char *orig = (unsigned char *) file_read(fname, &size, NULL);
+    unsigned char *buf = xmalloc(size);
+    // Entry of the first level and its map.
+    unsigned char *e = buf + HEADER_SIZE;
+    size_t maps = HEADER_SIZE + 5 * ENTRY_SIZE;
+
+    // Pack is cut to size if it is not 0.
+    struct {
+        const char *name;
+        size_t size;
+        const char *err;
+    } cases[] = {
+        {"magic", 0, "invalid level pack"},
+        {"version", 0, "invalid level pack"},
+        {"truncated header", HEADER_SIZE - 1, "invalid level pack"},
+        {"index out of file", 0, "invalid level pack"},
+        {"offset into header", 0, "overlaps the index"},
+        {"offset into index", 0, "overlaps the index"},
+        {"map out of file", size - 1, "out of file"},
+        {"map size", 0, "unsupported size"},
+        {"tile", 0, "unsupported tile"},
+        {"gold", 0, "wrong number of gold"},
+        {"guards", 0, "wrong number of gold or guards"},
+    };
+    int ncases = sizeof(cases) / sizeof(cases[0]);
+
+    for (int i = 0; i < ncases; i++) {
+        memcpy(buf, orig, size);
+        switch (i) {
+        case 0:
+            buf[0] = 'X';
+            break;
+        case 1:
+            buf[4] = 3;
+            break;
+        case 3:
+            put_u32(buf + 12, size);
+            break;
+        case 4:
+            put_u32(e, 4);
+            break;
+        case 5:
+            put_u32(e, maps - 1);
+            break;
+        case 7:
+            e[6] = MAP_WIDTH - 1;
+            break;
+        case 8:
+            buf[maps] = '?';
+            break;
+        case 9:
+            e[4]++;
+            break;
+        case 10:
+            e[5]--;
+            break;
+        }
+        write_pack(buf, cases[i].size != 0 ? cases[i].size : size);
+        if (!dies(open_run, NULL, cases[i].err)) {
+            die("corrupt pack is not rejected: %s", cases[i].name);
+        }
+    }
+
+    // The original is still fine.
+    write_pack(orig, size);
+    if (dies(open_run, NULL, "")) {
+        die("valid pack is rejected");
+    }
+
+    free(buf);
+    free(orig);
+}
+
+int main()
+{
+    int fd = mkstemp(fname);
+    if (fd == -1) {
+        die("failed to create temporary file");
+    }
+    close(fd);
+
+    struct level *lvls[NLEVELS] = {
+        level_make(1, MAP_WIDTH, MAP_HEIGHT, MAX_GOLD, 5),
+        level_make(3, MAP_MAX_WIDTH, MAP_MAX_HEIGHT, 1, MAX_GUARDS),
+        level_make(5, 40, 24, 3, 64),
+    };
+    test_round_trip(lvls);
+    test_corrupt();
+
+    // Counts are stored in a byte, levels with more are refused.
+    struct level *gold = level_make(1, MAP_WIDTH, MAP_HEIGHT, MAX_GOLD + 1,
+        1);
+    struct level *guards = level_make(1, MAP_MAX_WIDTH, MAP_MAX_HEIGHT, 1,
+        MAX_GUARDS + 1);
+    if (!dies(save_run, gold, "gold") || !dies(save_run, guards, "guards")) {
+        die("level which does not fit is saved");
+    }
+    level_destroy(gold);
+    level_destroy(guards);
+
+    for (int i = 0; i < NLEVELS; i++) {
+        level_destroy(lvls[i]);
+    }
+    unlink(fname);
+
+    printf("pack: %d levels round-trip, corrupt packs are rejected\n",
+        NLEVELS);
+
+    return 0;
+}
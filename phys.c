@@ -1,19 +1,31 @@
 #include "phys.h"
 
 // Check if tile at x:y coordinates has requested type.
+// Everything outside of the map acts as a solid wall.
 bool is_tile(struct game *game, int x, int y, enum map_tile_t t)
 {
-    return game->map[y][x]->curt == t;
+    if (x < 0 || x >= game->map.w || y < 0 || y >= game->map.h) {
+        return t == MAP_TILE_SOLID;
+    }
+
+    enum map_board b = map_tile_board(t);
+    if (b == MAP_BOARD_SIZE) {
+        return false;
+    }
+
+    return map_boards(game, y)[b] >> x & 1;
 }
 
 // Returns true if runner or guard can move to tile with x:y coordinates.
 bool can_move(struct game *game, int x, int y)
 {
-    if (x < 0 || x >= MAP_WIDTH || y < 0 || y >= MAP_HEIGHT) {
+    if (x < 0 || x >= game->map.w || y < 0 || y >= game->map.h) {
         return false;
     }
 
-    return is_tile(game, x, y, MAP_TILE_EMPTY)
-        || is_tile(game, x, y, MAP_TILE_LADDER)
-        || is_tile(game, x, y, MAP_TILE_ROPE);
+    uint64_t *b = map_boards(game, y);
+    uint64_t row = b[MAP_BOARD_EMPTY] | b[MAP_BOARD_LADDER]
+        | b[MAP_BOARD_ROPE];
+
+    return row >> x & 1;
 }
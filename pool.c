@@ -0,0 +1,333 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "exit.h"
+#include "pool.h"
+#include "xmalloc.h"
+
+// Work-stealing thread pool.
+// Every worker owns a double-ended queue of tasks. Worker takes tasks from
+// the bottom of its own queue (most recently submitted first) and when it
+// runs out of work it steals from the top of other workers' queues (oldest
+// first), so long running tasks get spread across all workers without any
+// central queue all workers contend for. Threads waiting for their tasks
+// take tasks from the queues too, see pool_wait().
+
+#define DEQUE_INIT_CAP 64
+
+struct task {
+    pool_fn fn;
+    void *arg;
+    struct pool_group *group;
+};
+
+struct deque {
+    pthread_mutex_t lock;
+    struct task *tasks;
+    int cap;
+    // Index of the oldest task.
+    int top;
+    // Number of tasks in the queue.
+    int size;
+};
+
+struct worker {
+    struct pool *pool;
+    pthread_t thread;
+    int id;
+    struct deque q;
+};
+
+struct pool {
+    struct worker *workers;
+    int nworkers;
+    // Worker to push next task submitted from outside of the pool to.
+    atomic_int next;
+    // Number of tasks waiting in queues.
+    atomic_int queued;
+    // Number of workers sleeping on the work condition variable. Submitting
+    // a task takes the lock only to wake one of them up.
+    atomic_int idle;
+    bool stop;
+    // Protects stop flag and condition variables below.
+    pthread_mutex_t lock;
+    // Signaled when new tasks are submitted or pool is stopped.
+    pthread_cond_t work;
+    // Signaled when the last pending task of a group is completed.
+    pthread_cond_t done;
+};
+
+// Worker the current thread runs, NULL for threads outside of any pool.
+static _Thread_local struct worker *current = NULL;
+
+static void deque_init(struct deque *q)
+{
+    pthread_mutex_init(&q->lock, NULL);
+    q->cap = DEQUE_INIT_CAP;
+    q->tasks = xmalloc(sizeof(struct task) * q->cap);
+    q->top = 0;
+    q->size = 0;
+}
+
+static void deque_destroy(struct deque *q)
+{
+    pthread_mutex_destroy(&q->lock);
+    free(q->tasks);
+}
+
+static void deque_push(struct deque *q, struct task t)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->size == q->cap) {
+        struct task *tasks = xmalloc(sizeof(struct task) * q->cap * 2);
+        for (int i = 0; i < q->size; i++) {
+            tasks[i] = q->tasks[(q->top + i) % q->cap];
+        }
+        free(q->tasks);
+        q->tasks = tasks;
+        q->top = 0;
+        q->cap *= 2;
+    }
+    q->tasks[(q->top + q->size) % q->cap] = t;
+    q->size++;
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Take the most recently pushed task.
+static bool deque_pop(struct deque *q, struct task *t)
+{
+    bool ok = false;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->size > 0) {
+        q->size--;
+        *t = q->tasks[(q->top + q->size) % q->cap];
+        ok = true;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return ok;
+}
+
+// Take the oldest task.
+static bool deque_steal(struct deque *q, struct task *t)
+{
+    bool ok = false;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->size > 0) {
+        *t = q->tasks[q->top];
+        q->top = (q->top + 1) % q->cap;
+        q->size--;
+        ok = true;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return ok;
+}
+
+static bool worker_take(struct worker *w, struct task *t)
+{
+    struct pool *p = w->pool;
+
+    if (deque_pop(&w->q, t)) {
+        return true;
+    }
+    for (int i = 1; i < p->nworkers; i++) {
+        struct worker *v = &p->workers[(w->id + i) % p->nworkers];
+        if (deque_steal(&v->q, t)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Take the oldest task of any worker, for threads outside of the pool.
+static bool pool_steal(struct pool *p, struct task *t)
+{
+    for (int i = 0; i < p->nworkers; i++) {
+        if (deque_steal(&p->workers[i].q, t)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void task_run(struct pool *p, struct task *t)
+{
+    atomic_fetch_sub(&p->queued, 1);
+    t->fn(t->arg);
+    if (atomic_fetch_sub(&t->group->pending, 1) == 1) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_broadcast(&p->done);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+static void *worker_run(void *arg)
+{
+    struct worker *w = arg;
+    struct pool *p = w->pool;
+    current = w;
+
+    for (;;) {
+        struct task t;
+        if (worker_take(w, &t)) {
+            task_run(p, &t);
+            continue;
+        }
+
+        // Submitters check idle after queueing the task and workers check
+        // queued after becoming idle, so one of them sees the other.
+        pthread_mutex_lock(&p->lock);
+        atomic_fetch_add(&p->idle, 1);
+        while (!p->stop && atomic_load(&p->queued) == 0) {
+            pthread_cond_wait(&p->work, &p->lock);
+        }
+        atomic_fetch_sub(&p->idle, 1);
+        bool stop = p->stop;
+        pthread_mutex_unlock(&p->lock);
+        if (stop) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Start pool of nthreads workers. Zero or negative number means one worker
+ * per online CPU.
+ */
+struct pool *pool_init(int nthreads)
+{
+    if (nthreads <= 0) {
+        nthreads = pool_ncpu();
+    }
+
+    struct pool *p = xmalloc(sizeof(struct pool));
+    p->workers = xmalloc(sizeof(struct worker) * nthreads);
+    p->nworkers = nthreads;
+    atomic_init(&p->next, 0);
+    atomic_init(&p->queued, 0);
+    atomic_init(&p->idle, 0);
+    p->stop = false;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+        struct worker *w = &p->workers[i];
+        w->pool = p;
+        w->id = i;
+        deque_init(&w->q);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        struct worker *w = &p->workers[i];
+        if (pthread_create(&w->thread, NULL, worker_run, w) != 0) {
+            die("failed to start pool worker");
+        }
+    }
+
+    return p;
+}
+
+/*
+ * Stop workers. All submitted tasks must be waited for.
+ */
+void pool_destroy(struct pool *p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->stop = true;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+
+    // Workers steal from each other's queues until they stop.
+    for (int i = 0; i < p->nworkers; i++) {
+        pthread_join(p->workers[i].thread, NULL);
+    }
+    for (int i = 0; i < p->nworkers; i++) {
+        deque_destroy(&p->workers[i].q);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->done);
+    free(p->workers);
+    free(p);
+}
+
+/*
+ * Initialize empty group of tasks.
+ */
+void pool_group_init(struct pool_group *g)
+{
+    atomic_init(&g->pending, 0);
+}
+
+/*
+ * Schedule fn(arg) to be called on one of the pool's workers as a task of
+ * group g. Tasks submitted by a worker go to its own queue, tasks submitted
+ * from outside of the pool are spread over workers round-robin.
+ */
+void pool_submit(struct pool *p, struct pool_group *g, pool_fn fn,
+    void *arg)
+{
+    struct task t = {fn, arg, g};
+    struct worker *w = current;
+
+    if (w == NULL || w->pool != p) {
+        int i = atomic_fetch_add(&p->next, 1);
+        w = &p->workers[(unsigned) i % p->nworkers];
+    }
+
+    atomic_fetch_add(&g->pending, 1);
+    atomic_fetch_add(&p->queued, 1);
+    deque_push(&w->q, t);
+
+    if (atomic_load(&p->idle) > 0) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_signal(&p->work);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+/*
+ * Block until all tasks of group g are completed. Tasks of other groups
+ * are not waited for. Meanwhile the calling thread runs queued tasks
+ * itself, so a few short tasks are often done before the workers wake up.
+ * Must not be called from the pool's own workers.
+ */
+void pool_wait(struct pool *p, struct pool_group *g)
+{
+    struct task t;
+
+    while (atomic_load(&g->pending) > 0 && pool_steal(p, &t)) {
+        task_run(p, &t);
+    }
+
+    // The group's tasks left are running on workers, the caller is the
+    // only one to submit more of them.
+    pthread_mutex_lock(&p->lock);
+    while (atomic_load(&g->pending) > 0) {
+        pthread_cond_wait(&p->done, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+int pool_size(struct pool *p)
+{
+    return p->nworkers;
+}
+
+/*
+ * Return number of online CPUs.
+ */
+int pool_ncpu()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (int) n : 1;
+}
@@ -0,0 +1,28 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stdatomic.h>
+
+typedef void (*pool_fn)(void *arg);
+
+struct pool;
+
+/*
+ * Tasks waited for together, see pool_wait(). Users sharing a pool wait
+ * only for their own tasks by submitting them into their own groups.
+ */
+struct pool_group {
+    // Number of submitted but not yet completed tasks.
+    atomic_int pending;
+};
+
+struct pool *pool_init(int nthreads);
+void pool_destroy(struct pool *p);
+void pool_group_init(struct pool_group *g);
+void pool_submit(struct pool *p, struct pool_group *g, pool_fn fn,
+    void *arg);
+void pool_wait(struct pool *p, struct pool_group *g);
+int pool_size(struct pool *p);
+int pool_ncpu();
+
+#endif /* POOL_H_ */
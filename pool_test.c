@@ -0,0 +1,181 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "exit.h"
+#include "game.h"
+#include "key.h"
+#include "level.h"
+#include "pool.h"
+
+// Thread pool test. Checks that tasks of a group are all run before
+// pool_wait() returns, that waiting for a group does not wait for tasks of
+// another one sharing the pool, and that guards decided on the pool move
+// exactly like guards decided one by one.
+
+#define NTASKS 1000
+#define TICKS 3000
+#define KEYS "arrrrrrrrrrzllllllllllxuuuuddd"
+// Map with enough guards for their moves to be decided on the pool, see
+// AI_PARALLEL_MOVES.
+#define MAP_W MAP_MAX_WIDTH
+#define MAP_H 32
+#define NGUARDS 120
+
+static atomic_int counts[2];
+// Long task of the other group is started and may finish.
+static atomic_bool started;
+static atomic_bool release;
+
+static void count_run(void *arg)
+{
+    atomic_fetch_add((atomic_int *) arg, 1);
+}
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = {0, ms * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+// Block until released, at most for a few seconds.
+static void block_run(void *arg)
+{
+    atomic_store(&started, true);
+    for (int i = 0; i < 5000 && !atomic_load(&release); i++) {
+        sleep_ms(1);
+    }
+    atomic_store((atomic_bool *) arg, atomic_load(&release));
+}
+
+static void test_groups()
+{
+    struct pool *pool = pool_init(2);
+    struct pool_group blocked;
+    struct pool_group group;
+    atomic_bool released = false;
+
+    // Occupy a worker with a task of another group which finishes only
+    // after the group below is waited for.
+    pool_group_init(&blocked);
+    pool_submit(pool, &blocked, block_run, &released);
+    while (!atomic_load(&started)) {
+        sleep_ms(1);
+    }
+
+    for (int round = 0; round < 2; round++) {
+        pool_group_init(&group);
+        for (int i = 0; i < NTASKS; i++) {
+            pool_submit(pool, &group, count_run, &counts[round]);
+        }
+        pool_wait(pool, &group);
+        if (atomic_load(&counts[round]) != NTASKS) {
+            die("round %d: %d of %d tasks are run", round,
+                atomic_load(&counts[round]), NTASKS);
+        }
+    }
+
+    atomic_store(&release, true);
+    pool_wait(pool, &blocked);
+    if (!atomic_load(&released)) {
+        die("group waited for the other group's task");
+    }
+    pool_destroy(pool);
+}
+
+// Floors of bricks four rows apart joined by ladders, guards spread over
+// the floors.
+static struct level *level_make()
+{
+    static char buf[MAP_H * (MAP_W + 1) + 1];
+    char *b = buf;
+    int nguards = 0;
+
+    for (int y = 0; y < MAP_H; y++) {
+        for (int x = 0; x < MAP_W; x++) {
+            char c = ' ';
+            if (y == MAP_H - 1) {
+                c = '@';
+            } else if (y % 4 == 3) {
+                c = x % 16 == 5 ? 'H' : '#';
+            } else if (x % 16 == 5) {
+                c = 'H';
+            } else if (y % 4 == 2 && x % 2 == 0 && nguards < NGUARDS) {
+                c = '0';
+                nguards++;
+            } else if (y == MAP_H - 2 && x == MAP_W / 2 + 1) {
+                c = '&';
+            } else if (y == 2 && x == MAP_W - 3) {
+                c = '$';
+            }
+            *b++ = c;
+        }
+        *b++ = '\n';
+    }
+    *b = '\0';
+
+    char err[128];
+    struct level *lvl = level_parse(1, buf, strlen(buf), err, sizeof(err),
+        NULL);
+    if (lvl == NULL) {
+        die("invalid test level: %s", err);
+    }
+
+    return lvl;
+}
+
+static void test_decisions(struct level *lvl, enum ai_mode mode,
+    int nthreads)
+{
+    struct game_opts serial = {mode, NULL, NULL, NULL};
+    struct game_opts parallel = {mode, pool_init(nthreads), NULL, NULL};
+    uint64_t seed = 1;
+    struct game *a = game_init(lvl, seed, &serial, NULL);
+    struct game *b = game_init(lvl, seed, &parallel, NULL);
+    if (a->nguards != NGUARDS) {
+        die("test level has %d guards", a->nguards);
+    }
+
+    enum key keys[sizeof(KEYS)];
+    for (int i = 0; KEYS[i] != '\0'; i++) {
+        keys[i] = key_parse(KEYS[i]);
+    }
+    for (int i = 0; i < TICKS; i++) {
+        enum key k = keys[i % (sizeof(KEYS) - 1)];
+        bool enda = game_tick(a, k);
+        bool endb = game_tick(b, k);
+        if (enda != endb || game_hash(a) != game_hash(b)) {
+            die("%s on %d threads: tick %d differs",
+                mode == AI_MODE_FLOW ? "flow" : "scan", nthreads, i);
+        }
+        // Runner is caught soon, the level is played again then.
+        if (enda) {
+            game_destroy(a);
+            game_destroy(b);
+            seed++;
+            a = game_init(lvl, seed, &serial, NULL);
+            b = game_init(lvl, seed, &parallel, NULL);
+        }
+    }
+
+    game_destroy(a);
+    game_destroy(b);
+    pool_destroy(parallel.pool);
+}
+
+int main()
+{
+    test_groups();
+
+    struct level *lvl = level_make();
+    for (int n = 1; n <= 3; n++) {
+        test_decisions(lvl, AI_MODE_SCAN, n);
+        test_decisions(lvl, AI_MODE_FLOW, n);
+    }
+    level_destroy(lvl);
+
+    printf("pool: groups and %d guards' decisions match\n", NGUARDS);
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "exit.h"
+#include "prof.h"
+
+// Frame phases profiler of the game frontend. Time spent in every phase is
+// summed up during a frame and stored into the rolling window of the last
+// PROF_WINDOW frames percentiles are computed over. Optionally every frame
+// is written as a CSV row.
+// Phases are timed back to back with prof_mark() and prof_lap(), so no
+// time is accounted twice. Game tick phases are timed through the game's
+// phase hook, see struct game_opts. Profiler is not thread-safe and must be
+// used from the main thread only.
+
+#define PROF_WINDOW 256
+
+static const char *names[PROF_SIZE] = {
+    [PROF_AI_TICK] = "ai_tick",
+    [PROF_COLLISION] = "detect_collision",
+    [PROF_FRAME] = "frame",
+    [PROF_GAME_RENDER] = "game_render",
+    [PROF_KEYHOLE] = "keyhole_render",
+    [PROF_MAP_TICK] = "map_tick",
+    [PROF_PRESENT] = "present",
+    [PROF_RUNNER_TICK] = "runner_tick",
+};
+
+static bool enabled = false;
+static FILE *csv = NULL;
+static char *csvname = NULL;
+static long frames = 0;
+// Start of the current phase, see prof_lap().
+static uint64_t mark = 0;
+// Time spent in every phase during the current frame.
+static uint64_t cur[PROF_SIZE];
+static uint32_t window[PROF_SIZE][PROF_WINDOW];
+
+/*
+ * Enable profiler. If csv is not NULL every frame is written into it.
+ * Calls die() on error.
+ */
+void prof_init(char *fname)
+{
+    enabled = true;
+    frames = 0;
+    memset(cur, 0, sizeof(cur));
+    memset(window, 0, sizeof(window));
+
+    if (fname == NULL) {
+        return;
+    }
+    csv = fopen(fname, "w");
+    if (csv == NULL) {
+        die("failed to open %s: %s", fname, strerror(errno));
+    }
+    csvname = fname;
+    fprintf(csv, "frame");
+    for (int i = 0; i < PROF_SIZE; i++) {
+        fprintf(csv, ",%s_us", names[i]);
+    }
+    fprintf(csv, "\n");
+}
+
+/*
+ * Disable profiler and close CSV file. Calls die() on error.
+ */
+void prof_destroy()
+{
+    enabled = false;
+    if (csv != NULL) {
+        if (ferror(csv) || fclose(csv) != 0) {
+            die("failed to write %s: %s", csvname, strerror(errno));
+        }
+        csv = NULL;
+    }
+}
+
+/*
+ * Return current time in nanoseconds, 0 if profiler is disabled.
+ */
+uint64_t prof_now()
+{
+    if (!enabled) {
+        return 0;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Account time passed since start (see prof_now()) to the phase.
+ */
+void prof_add(enum prof_phase p, uint64_t start)
+{
+    if (!enabled) {
+        return;
+    }
+
+    cur[p] += prof_now() - start;
+}
+
+/*
+ * Start timing the next phase.
+ */
+void prof_mark()
+{
+    mark = prof_now();
+}
+
+/*
+ * Account time passed since the last prof_mark() or prof_lap() to the
+ * phase and start timing the next phase.
+ */
+void prof_lap(enum prof_phase p)
+{
+    if (!enabled) {
+        return;
+    }
+
+    uint64_t t = prof_now();
+    cur[p] += t - mark;
+    mark = t;
+}
+
+/*
+ * Finish current frame.
+ */
+void prof_frame()
+{
+    if (!enabled) {
+        return;
+    }
+
+    int w = frames % PROF_WINDOW;
+    for (int i = 0; i < PROF_SIZE; i++) {
+        window[i][w] = cur[i] > UINT32_MAX ? UINT32_MAX : cur[i];
+    }
+    if (csv != NULL) {
+        fprintf(csv, "%ld", frames);
+        for (int i = 0; i < PROF_SIZE; i++) {
+            fprintf(csv, ",%.1f", cur[i] / 1e3);
+        }
+        fprintf(csv, "\n");
+    }
+    memset(cur, 0, sizeof(cur));
+    frames++;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Compute phase statistics over the last frames.
+ */
+void prof_stats(enum prof_phase p, struct prof_stats *st)
+{
+    int n = frames < PROF_WINDOW ? frames : PROF_WINDOW;
+    if (n == 0) {
+        st->p50 = st->p99 = st->max = 0;
+        return;
+    }
+
+    uint32_t s[PROF_WINDOW];
+    memcpy(s, window[p], sizeof(uint32_t) * n);
+    qsort(s, n, sizeof(uint32_t), cmp_u32);
+    st->p50 = s[(n - 1) * 50 / 100];
+    st->p99 = s[(n - 1) * 99 / 100];
+    st->max = s[n - 1];
+}
+
+const char *prof_name(enum prof_phase p)
+{
+    return names[p];
+}
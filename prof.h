@@ -0,0 +1,39 @@
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum prof_phase {
+    PROF_AI_TICK,
+    PROF_COLLISION,
+    PROF_FRAME,
+    PROF_GAME_RENDER,
+    PROF_KEYHOLE,
+    PROF_MAP_TICK,
+    PROF_PRESENT,
+    PROF_RUNNER_TICK,
+    // Keep it last.
+    PROF_SIZE,
+};
+
+/*
+ * Phase time statistics over the last frames, in nanoseconds.
+ */
+struct prof_stats {
+    uint32_t p50;
+    uint32_t p99;
+    uint32_t max;
+};
+
+void prof_init(char *csv);
+void prof_destroy();
+uint64_t prof_now();
+void prof_add(enum prof_phase p, uint64_t start);
+void prof_mark();
+void prof_lap(enum prof_phase p);
+void prof_frame();
+void prof_stats(enum prof_phase p, struct prof_stats *st);
+const char *prof_name(enum prof_phase p);
+
+#endif /* PROF_H_ */
@@ -1,20 +1,555 @@
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 #include "exit.h"
+#include "game.h"
+#include "gold.h"
+#include "guard.h"
+#include "keyhole.h"
+#include "prof.h"
 #include "render.h"
+#include "runner.h"
+#include "texture.h"
+#include "tile.h"
+
+void die_sdl(char *func)
+{
+    const char *sdl = SDL_GetError();
+    char *buf = NULL;
+    asprintf(&buf, "%s: %s", func, sdl);
+    die(buf);
+}
+
+// Sprites are not drawn immediately but collected into the vertex buffer
+// and drawn from the texture atlas with a single SDL_RenderGeometry() call
+// when the buffer is full or flushed by render_flush().
+#define BATCH_QUADS 1024
+
+static SDL_Vertex batch_verts[BATCH_QUADS * 4];
+static int batch_indices[BATCH_QUADS * 6];
+static int batch_nquads = 0;
+
+/*
+ * Draw all sprites collected so far.
+ */
+void render_flush(SDL_Renderer *renderer)
+{
+    if (batch_nquads == 0) {
+        return;
+    }
+    if (batch_indices[1] == 0) {
+        // Two triangles per quad.
+        for (int i = 0; i < BATCH_QUADS; i++) {
+            int *idx = &batch_indices[i * 6];
+            idx[0] = i * 4;
+            idx[1] = i * 4 + 1;
+            idx[2] = i * 4 + 2;
+            idx[3] = i * 4 + 2;
+            idx[4] = i * 4 + 3;
+            idx[5] = i * 4;
+        }
+    }
+
+    if (SDL_RenderGeometry(renderer, texture_atlas(), batch_verts,
+            batch_nquads * 4, batch_indices, batch_nquads * 6) < 0) {
+        die_sdl("SDL_RenderGeometry");
+    }
+    batch_nquads = 0;
+}
+
+/*
+ * Draw sprite stretched to w x h at x:y.
+ */
+static void quad(SDL_Renderer *renderer, struct sprite *s, int x, int y,
+    int w, int h)
+{
+    if (batch_nquads == BATCH_QUADS) {
+        render_flush(renderer);
+    }
+
+    int aw;
+    int ah;
+    texture_atlas_size(&aw, &ah);
+    SDL_Rect *t = texture_rect(s->texture);
+    float u0 = (float) (t->x + s->x) / aw;
+    float v0 = (float) (t->y + s->y) / ah;
+    float u1 = (float) (t->x + s->x + s->w) / aw;
+    float v1 = (float) (t->y + s->y + s->h) / ah;
+
+    SDL_Vertex *v = &batch_verts[batch_nquads * 4];
+    SDL_Color white = {0xff, 0xff, 0xff, 0xff};
+    v[0] = (SDL_Vertex) {{x, y}, white, {u0, v0}};
+    v[1] = (SDL_Vertex) {{x + w, y}, white, {u1, v0}};
+    v[2] = (SDL_Vertex) {{x + w, y + h}, white, {u1, v1}};
+    v[3] = (SDL_Vertex) {{x, y + h}, white, {u0, v1}};
+    batch_nquads++;
+}
 
 void render(SDL_Renderer *renderer, struct sprite *s, int x, int y)
 {
-    SDL_Rect src;
-    src.x = s->x;
-    src.y = s->y;
-    src.w = s->w;
-    src.h = s->h;
-    SDL_Rect dst;
-    dst.x = x;
-    dst.y = y;
-    dst.w = s->w;
-    dst.h = s->h;
-    if (SDL_RenderCopy(renderer, s->texture, &src, &dst) < 0) {
+    quad(renderer, s, x, y, s->w, s->h);
+}
+
+// Font image is a grid of glyphs: digits, letters and a few pictures.
+#define GLYPH_COLS 10
+#define GLYPH_ROWS 6
+#define GLYPH_GOLD 40
+#define GLYPH_GUARD 41
+#define GLYPH_SPACE 43
+
+// Map is drawn through the viewport of the classic map size. Larger maps are
+// scrolled to keep the runner in the view, only tiles and actors inside the
+// view are drawn.
+#define VIEW_WIDTH (MAP_WIDTH * TILE_MAP_WIDTH)
+#define VIEW_HEIGHT (MAP_HEIGHT * TILE_MAP_HEIGHT + TILE_GROUND_HEIGHT)
+// Most tiles partially visible through the view when it is not aligned to
+// the tile grid.
+#define VIEW_MAX_TILES ((VIEW_HEIGHT / TILE_MAP_HEIGHT + 2) \
+    * (VIEW_WIDTH / TILE_MAP_WIDTH + 2))
+
+// Status line is drawn into the cached HUD texture which is redrawn only
+// when displayed values change.
+#define HUD_WIDTH VIEW_WIDTH
+#define HUD_SCORE 100500
+
+static struct sprite glyphs[GLYPH_COLS * GLYPH_ROWS];
+static bool glyphs_ready = false;
+
+static SDL_Texture *hud = NULL;
+static bool hud_valid = false;
+static int hud_lives;
+static int hud_level;
+
+static struct sprite *glyph(char ch, bool img)
+{
+    if (!glyphs_ready) {
+        for (int i = 0; i < GLYPH_COLS * GLYPH_ROWS; i++) {
+            struct sprite *g = &glyphs[i];
+            g->texture = TEXTURE_TEXT;
+            g->x = i % GLYPH_COLS * TILE_TEXT_WIDTH;
+            g->y = i / GLYPH_COLS * TILE_TEXT_HEIGHT;
+            g->w = TILE_TEXT_WIDTH;
+            g->h = TILE_TEXT_HEIGHT;
+            g->frames = 0;
+        }
+        glyphs_ready = true;
+    }
+
+    int idx;
+    if (img && ch == MAP_TILE_GOLD) {
+        idx = GLYPH_GOLD;
+    } else if (img && ch == MAP_TILE_GUARD) {
+        idx = GLYPH_GUARD;
+    } else if (ch == ' ') {
+        idx = GLYPH_SPACE;
+    } else if (ch >= 'A' && ch <= 'Z') {
+        idx = 10 + ch - 'A';
+    } else if (ch >= '0' && ch <= '9') {
+        idx = 0 + ch - '0';
+    } else {
+        die("TODO:");
+    }
+
+    return &glyphs[idx];
+}
+
+/*
+ * Draw text at x:y with glyphs scaled down by div. Backslash followed by
+ * a map tile character draws the tile's picture, e.g. "\\$" is gold.
+ */
+static void text_render(SDL_Renderer *renderer, char *s, int x, int y,
+    int div)
+{
+    int w = TILE_TEXT_WIDTH / div;
+    int h = TILE_TEXT_HEIGHT / div;
+    int n = 0;
+    for (; *s != '\0'; s++, n++) {
+        bool img = false;
+        if (*s == '\\' && s[1] != '\0') {
+            s++;
+            img = true;
+        }
+        quad(renderer, glyph(*s, img), x + n * w, y, w, h);
+    }
+}
+
+/*
+ * Switch rendering to texture target, NULL for the screen. Sprites collected
+ * so far are drawn into the previous target.
+ */
+static void target_set(SDL_Renderer *renderer, SDL_Texture *target)
+{
+    render_flush(renderer);
+    if (SDL_SetRenderTarget(renderer, target) < 0) {
+        die_sdl("SDL_SetRenderTarget");
+    }
+}
+
+/*
+ * Clear rects of the current render target to transparent, the whole
+ * target if rects is NULL.
+ */
+static void target_clear(SDL_Renderer *renderer, SDL_Rect *rects, int n)
+{
+    Uint8 r, g, b, a;
+    SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
+    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0x00);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+    if (rects == NULL) {
+        SDL_RenderClear(renderer);
+    } else if (SDL_RenderFillRects(renderer, rects, n) < 0) {
+        die_sdl("SDL_RenderFillRects");
+    }
+    SDL_SetRenderDrawColor(renderer, r, g, b, a);
+}
+
+static SDL_Texture *target_init(SDL_Renderer *renderer, int w, int h)
+{
+    SDL_Texture *t = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_TARGET, w, h);
+    if (t == NULL) {
+        die_sdl("SDL_CreateTexture");
+    }
+    SDL_SetTextureBlendMode(t, SDL_BLENDMODE_BLEND);
+
+    return t;
+}
+
+/*
+ * Redraw status line if any of displayed values has changed and draw it.
+ */
+static void hud_render(SDL_Renderer *renderer, struct game *game)
+{
+    if (hud == NULL) {
+        hud = target_init(renderer, HUD_WIDTH, TILE_TEXT_HEIGHT);
+    }
+
+    if (!hud_valid || hud_lives != game->lives || hud_level != game->level) {
+        target_set(renderer, hud);
+        target_clear(renderer, NULL, 0);
+
+        char buf[48];
+        snprintf(buf, sizeof(buf), "SCORE%07d MEN%03d LEVEL%03d",
+            HUD_SCORE, game->lives, game->level);
+        text_render(renderer, buf, 0, 0, 1);
+        target_set(renderer, NULL);
+
+        hud_valid = true;
+        hud_lives = game->lives;
+        hud_level = game->level;
+    }
+
+    SDL_Rect dst = {0, VIEW_HEIGHT, HUD_WIDTH, TILE_TEXT_HEIGHT};
+    if (SDL_RenderCopy(renderer, hud, NULL, &dst) < 0) {
         die_sdl("SDL_RenderCopy");
     }
 }
+
+// Top left corner of the viewport on the map in pixels.
+static SDL_Point camera = {0, 0};
+
+// Static map layer: map tiles and ground are drawn into the background
+// texture of the map size once and only visible tiles whose sprites have
+// changed since are redrawn.
+// Sprites tiles are currently drawn with, NULL for empty tiles.
+static SDL_Texture *background = NULL;
+static int background_w = 0;
+static int background_h = 0;
+static bool background_valid = false;
+static struct sprite *background_tiles[MAP_MAX_HEIGHT][MAP_MAX_WIDTH];
+
+/*
+ * Make cached textures to be redrawn from scratch, e.g. when render targets
+ * have been lost.
+ */
+void render_reset()
+{
+    background_valid = false;
+    hud_valid = false;
+}
+
+/*
+ * Interpolate screen coordinate between previous and current tick. Jumps
+ * longer than a tile (e.g. guard reborn) are not interpolated.
+ */
+static int lerp(int prev, int cur, float alpha, int tile)
+{
+    if (abs(cur - prev) > tile) {
+        return cur;
+    }
+
+    return prev + (int) lroundf((cur - prev) * alpha);
+}
+
+static int clamp(int v, int min, int max)
+{
+    return v < min ? min : v > max ? max : v;
+}
+
+/*
+ * Center the viewport on the runner but keep it inside the map.
+ */
+static void camera_update(struct game *game, struct game *prev, float alpha)
+{
+    struct map *m = &game->map;
+    if (m->w == MAP_WIDTH && m->h == MAP_HEIGHT) {
+        camera = (SDL_Point) {0, 0};
+        return;
+    }
+
+    struct runner *r = &game->runner;
+    struct runner *p = &prev->runner;
+    int x = lerp(p->x * TILE_MAP_WIDTH + p->tx,
+        r->x * TILE_MAP_WIDTH + r->tx, alpha, TILE_MAP_WIDTH);
+    int y = lerp(p->y * TILE_MAP_HEIGHT + p->ty,
+        r->y * TILE_MAP_HEIGHT + r->ty, alpha, TILE_MAP_HEIGHT);
+    camera.x = clamp(x + (TILE_MAP_WIDTH - VIEW_WIDTH) / 2,
+        0, (m->w - MAP_WIDTH) * TILE_MAP_WIDTH);
+    camera.y = clamp(y + (TILE_MAP_HEIGHT - VIEW_HEIGHT) / 2,
+        0, (m->h - MAP_HEIGHT) * TILE_MAP_HEIGHT);
+}
+
+/*
+ * Draw sprite at x:y map coordinates if it is inside the viewport.
+ */
+static void view_render(SDL_Renderer *renderer, struct sprite *s, int x,
+    int y)
+{
+    x -= camera.x;
+    y -= camera.y;
+    if (x + s->w <= 0 || x >= VIEW_WIDTH || y + s->h <= 0
+        || y >= VIEW_HEIGHT) {
+        return;
+    }
+
+    render(renderer, s, x, y);
+}
+
+/*
+ * Redraw changed visible tiles of the background and draw the visible part
+ * of it.
+ */
+static void background_render(SDL_Renderer *renderer, struct game *game)
+{
+    struct map *m = &game->map;
+    int w = m->w * TILE_MAP_WIDTH;
+    int h = m->h * TILE_MAP_HEIGHT + TILE_GROUND_HEIGHT;
+
+    if (background != NULL && (background_w != w || background_h != h)) {
+        SDL_DestroyTexture(background);
+        background = NULL;
+    }
+    if (background == NULL) {
+        background = target_init(renderer, w, h);
+        background_w = w;
+        background_h = h;
+        background_valid = false;
+    }
+
+    if (!background_valid) {
+        target_set(renderer, background);
+        target_clear(renderer, NULL, 0);
+        struct animation grounda;
+        animation_init(&grounda, ANIMATION_GROUND);
+        for (int i = 0; i < m->w; i++) {
+            render(renderer, animation_sprite(&grounda),
+                i * TILE_GROUND_WIDTH, m->h * TILE_MAP_HEIGHT);
+        }
+        target_set(renderer, NULL);
+        // Cleared tiles are empty, invisible ones are drawn when they
+        // get into the view.
+        memset(background_tiles, 0, sizeof(background_tiles));
+        background_valid = true;
+    }
+
+    int x0 = camera.x / TILE_MAP_WIDTH;
+    int y0 = camera.y / TILE_MAP_HEIGHT;
+    int x1 = (camera.x + VIEW_WIDTH - 1) / TILE_MAP_WIDTH;
+    int y1 = (camera.y + VIEW_HEIGHT - 1) / TILE_MAP_HEIGHT;
+    if (x1 >= m->w) {
+        x1 = m->w - 1;
+    }
+    if (y1 >= m->h) {
+        y1 = m->h - 1;
+    }
+
+    SDL_Rect dirty[VIEW_MAX_TILES];
+    int ndirty = 0;
+    for (int i = y0; i <= y1; i++) {
+        struct animation *row = map_cura(game, i);
+        for (int j = x0; j <= x1; j++) {
+            struct sprite *s = animation_sprite(&row[j]);
+            if (background_tiles[i][j] == s) {
+                continue;
+            }
+            background_tiles[i][j] = s;
+            assert(ndirty < VIEW_MAX_TILES);
+            dirty[ndirty++] = (SDL_Rect) {j * TILE_MAP_WIDTH,
+                i * TILE_MAP_HEIGHT, TILE_MAP_WIDTH, TILE_MAP_HEIGHT};
+        }
+    }
+
+    if (ndirty > 0) {
+        target_set(renderer, background);
+        target_clear(renderer, dirty, ndirty);
+
+        for (int i = 0; i < ndirty; i++) {
+            struct sprite *s = background_tiles[dirty[i].y / TILE_MAP_HEIGHT]
+                [dirty[i].x / TILE_MAP_WIDTH];
+            if (s != NULL) {
+                render(renderer, s, dirty[i].x, dirty[i].y);
+            }
+        }
+        target_set(renderer, NULL);
+    }
+
+    SDL_Rect src = {camera.x, camera.y, VIEW_WIDTH, VIEW_HEIGHT};
+    SDL_Rect dst = {0, 0, VIEW_WIDTH, VIEW_HEIGHT};
+    if (SDL_RenderCopy(renderer, background, &src, &dst) < 0) {
+        die_sdl("SDL_RenderCopy");
+    }
+}
+
+static void runner_render(SDL_Renderer *renderer, struct runner *runner,
+    struct runner *prev, float alpha)
+{
+    view_render(renderer, animation_sprite(&runner->cura),
+        lerp(prev->x * TILE_MAP_WIDTH + prev->tx,
+            runner->x * TILE_MAP_WIDTH + runner->tx, alpha, TILE_MAP_WIDTH),
+        lerp(prev->y * TILE_MAP_HEIGHT + prev->ty,
+            runner->y * TILE_MAP_HEIGHT + runner->ty, alpha, TILE_MAP_HEIGHT));
+
+    if (runner->state == RSTATE_DIG_LEFT) {
+        view_render(renderer, animation_sprite(&runner->holea),
+            (runner->x - 1) * TILE_MAP_WIDTH,
+            (runner->y) * TILE_MAP_HEIGHT);
+    }
+    if (runner->state == RSTATE_DIG_RIGHT) {
+        view_render(renderer, animation_sprite(&runner->holea),
+            (runner->x + 1) * TILE_MAP_WIDTH,
+            (runner->y) * TILE_MAP_HEIGHT);
+    }
+}
+
+static void guard_render(SDL_Renderer *renderer, struct guard *g,
+    struct guard *prev, float alpha)
+{
+    // TODO: Check if it is alive and such.
+    view_render(renderer, animation_sprite(&g->cura),
+        lerp(prev->x * TILE_MAP_WIDTH + prev->tx,
+            g->x * TILE_MAP_WIDTH + g->tx, alpha, TILE_MAP_WIDTH),
+        lerp(prev->y * TILE_MAP_HEIGHT + prev->ty,
+            g->y * TILE_MAP_HEIGHT + g->ty, alpha, TILE_MAP_HEIGHT));
+}
+
+/*
+ * Render game state. Actors are drawn between their positions in the
+ * previous tick's state prev and the current one, alpha (0..1) is the
+ * part of the tick passed.
+ */
+void game_render(struct game *game, struct game *prev, float alpha,
+    SDL_Renderer *renderer)
+{
+    camera_update(game, prev, alpha);
+    background_render(renderer, game);
+
+    // Actors partially visible at the edges of the scrolled view must not
+    // be drawn over the status line. Classic map fits the view entirely.
+    bool clip = game->map.w != MAP_WIDTH || game->map.h != MAP_HEIGHT;
+    if (clip) {
+        SDL_Rect view = {0, 0, VIEW_WIDTH, VIEW_HEIGHT};
+        SDL_RenderSetClipRect(renderer, &view);
+    }
+
+    struct animation golda;
+    animation_init(&golda, ANIMATION_GOLD);
+    for (int i = 0; i < game->ngold; i++) {
+        struct gold *g = &game->gold[i];
+        if (g->visible) {
+            view_render(renderer, animation_sprite(&golda),
+                g->x * TILE_MAP_WIDTH, g->y * TILE_MAP_HEIGHT);
+        }
+    }
+
+    runner_render(renderer, &game->runner, &prev->runner, alpha);
+
+    for (int i = 0; i < game->nguards; i++) {
+        struct guard *g = &game_guards(game)[i];
+        guard_render(renderer, g,
+            i < prev->nguards ? &game_guards(prev)[i] : g, alpha);
+    }
+
+    render_flush(renderer);
+    if (clip) {
+        SDL_RenderSetClipRect(renderer, NULL);
+    }
+    hud_render(renderer, game);
+    prof_lap(PROF_GAME_RENDER);
+
+    if (game->state == GSTATE_START || game->state == GSTATE_END) {
+        keyhole_render(renderer, (int) game->keyhole);
+        prof_lap(PROF_KEYHOLE);
+    }
+}
+
+// Profiler overlay labels, the font has only capital letters and digits.
+static char *prof_labels[PROF_SIZE] = {
+    [PROF_AI_TICK] = "AI",
+    [PROF_COLLISION] = "COLLISION",
+    [PROF_FRAME] = "FRAME",
+    [PROF_GAME_RENDER] = "RENDER",
+    [PROF_KEYHOLE] = "KEYHOLE",
+    [PROF_MAP_TICK] = "MAP",
+    [PROF_PRESENT] = "PRESENT",
+    [PROF_RUNNER_TICK] = "RUNNER",
+};
+
+/*
+ * Draw profiler overlay: p50, p99 and max time of every phase over the last
+ * frames in microseconds.
+ */
+void prof_render(SDL_Renderer *renderer)
+{
+    const int div = 2;
+    const int h = TILE_TEXT_HEIGHT / div;
+    SDL_Rect bg = {0, 0, 27 * TILE_TEXT_WIDTH / div, (PROF_SIZE + 1) * h};
+
+    render_flush(renderer);
+    Uint8 r, g, b, a;
+    SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
+    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xc0);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_RenderFillRect(renderer, &bg);
+    SDL_SetRenderDrawColor(renderer, r, g, b, a);
+
+    text_render(renderer, "US           P50   P99   MAX", 0, 0, div);
+    for (int i = 0; i < PROF_SIZE; i++) {
+        struct prof_stats st;
+        prof_stats(i, &st);
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%-9s %5u %5u %5u", prof_labels[i],
+            st.p50 / 1000, st.p99 / 1000, st.max / 1000);
+        text_render(renderer, buf, 0, (i + 1) * h, div);
+    }
+    render_flush(renderer);
+}
+
+/*
+ * Free renderer's cached textures and sprites.
+ */
+void render_destroy()
+{
+    if (background != NULL) {
+        SDL_DestroyTexture(background);
+        background = NULL;
+    }
+    if (hud != NULL) {
+        SDL_DestroyTexture(hud);
+        hud = NULL;
+    }
+    render_reset();
+}
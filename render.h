@@ -1,8 +1,17 @@
 #ifndef RENDER_H_
 #define RENDER_H_
 
+#include <SDL2/SDL.h>
 #include "animation.h"
+#include "game.h"
 
+void die_sdl(char *func);
+void render_flush(SDL_Renderer *renderer);
 void render(SDL_Renderer *renderer, struct sprite *s, int x, int y);
+void game_render(struct game *game, struct game *prev, float alpha,
+    SDL_Renderer *renderer);
+void prof_render(SDL_Renderer *renderer);
+void render_reset();
+void render_destroy();
 
 #endif /* RENDER_H_ */
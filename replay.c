@@ -0,0 +1,246 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "exit.h"
+#include "file.h"
+#include "replay.h"
+#include "xmalloc.h"
+
+// Replay file format. All integers are little-endian.
+//
+//     "LRRP"    magic
+//     u8        format version
+//     u32       starting level number
+//     u64       RNG seed
+//     runs...   until the end of file
+//
+// Every run is a number of ticks encoded as unsigned LEB128 varint followed
+// by a single byte key (enum key) pressed during those ticks.
+
+#define REPLAY_MAGIC "LRRP"
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE (4 + 1 + 4 + 8)
+#define REPLAY_INIT_CAP 64
+
+struct replay *replay_init(int level, uint64_t seed)
+{
+    struct replay *r = xmalloc(sizeof(struct replay));
+    r->level = level;
+    r->seed = seed;
+    r->cap = REPLAY_INIT_CAP;
+    r->runs = xmalloc(sizeof(struct replay_run) * r->cap);
+    r->nruns = 0;
+    replay_rewind(r);
+
+    return r;
+}
+
+void replay_destroy(struct replay *r)
+{
+    free(r->runs);
+    free(r);
+}
+
+static void replay_append(struct replay *r, uint32_t n, enum key k)
+{
+    if (r->nruns == r->cap) {
+        r->cap *= 2;
+        struct replay_run *runs = xmalloc(sizeof(struct replay_run) * r->cap);
+        memcpy(runs, r->runs, sizeof(struct replay_run) * r->nruns);
+        free(r->runs);
+        r->runs = runs;
+    }
+    r->runs[r->nruns].n = n;
+    r->runs[r->nruns].key = k;
+    r->nruns++;
+}
+
+/*
+ * Record key pressed during the next game tick.
+ */
+void replay_record(struct replay *r, enum key k)
+{
+    struct replay_run *last = r->nruns > 0 ? &r->runs[r->nruns - 1] : NULL;
+
+    if (last != NULL && last->key == k && last->n < UINT32_MAX) {
+        last->n++;
+    } else {
+        replay_append(r, 1, k);
+    }
+}
+
+/*
+ * Get key for the next game tick.
+ * Returns false when the end of the replay is reached.
+ */
+bool replay_next(struct replay *r, enum key *k)
+{
+    while (r->run < r->nruns && r->played >= r->runs[r->run].n) {
+        r->run++;
+        r->played = 0;
+    }
+    if (r->run >= r->nruns) {
+        return false;
+    }
+
+    *k = r->runs[r->run].key;
+    r->played++;
+
+    return true;
+}
+
+/*
+ * Check if all recorded keys have been played back, so replay_next() would
+ * return false. Unlike the playback position it does not lag behind when
+ * the last played key ends its run.
+ */
+bool replay_done(struct replay *r)
+{
+    int run = r->run;
+    uint32_t played = r->played;
+    while (run < r->nruns && played >= r->runs[run].n) {
+        run++;
+        played = 0;
+    }
+
+    return run >= r->nruns;
+}
+
+/*
+ * Move playback position back to the first tick.
+ */
+void replay_rewind(struct replay *r)
+{
+    r->run = 0;
+    r->played = 0;
+}
+
+/*
+ * Return total number of ticks recorded.
+ */
+long replay_ticks(struct replay *r)
+{
+    long n = 0;
+    for (int i = 0; i < r->nruns; i++) {
+        n += r->runs[i].n;
+    }
+
+    return n;
+}
+
+/*
+ * Check if buffer looks like a replay (starts with replay magic).
+ */
+bool replay_is(const char *buf, size_t len)
+{
+    return len >= 4 && memcmp(buf, REPLAY_MAGIC, 4) == 0;
+}
+
+static uint64_t get_le(const unsigned char *b, int n)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) {
+        v |= (uint64_t) b[i] << (i * 8);
+    }
+
+    return v;
+}
+
+/*
+ * Parse replay from memory.
+ * Returns NULL if buffer does not contain a valid replay.
+ */
+struct replay *replay_parse(const char *buf, size_t len)
+{
+    const unsigned char *b = (const unsigned char *) buf;
+
+    if (len < REPLAY_HEADER_SIZE || !replay_is(buf, len)
+        || b[4] != REPLAY_VERSION) {
+        return NULL;
+    }
+
+    struct replay *r = replay_init(get_le(b + 5, 4), get_le(b + 9, 8));
+    size_t i = REPLAY_HEADER_SIZE;
+    while (i < len) {
+        uint64_t n = 0;
+        int shift = 0;
+        for (;;) {
+            if (i >= len || shift > 28) {
+                replay_destroy(r);
+                return NULL;
+            }
+            n |= (uint64_t) (b[i] & 0x7f) << shift;
+            shift += 7;
+            if ((b[i++] & 0x80) == 0) {
+                break;
+            }
+        }
+        if (i >= len || n == 0 || n > UINT32_MAX || b[i] > KEY_UP) {
+            replay_destroy(r);
+            return NULL;
+        }
+        replay_append(r, n, b[i++]);
+    }
+
+    return r;
+}
+
+/*
+ * Load replay from file. Calls die() on error.
+ * It is caller's responsibility to free returned object.
+ */
+struct replay *replay_load(char *fname)
+{
+    size_t len;
+    char *buf = file_read(fname, &len, NULL);
+    struct replay *r = replay_parse(buf, len);
+    free(buf);
+
+    if (r == NULL) {
+        die("invalid replay file %s", fname);
+    }
+
+    return r;
+}
+
+/*
+ * Write replay into file. Calls die() on error.
+ */
+void replay_save(struct replay *r, char *fname)
+{
+    FILE *f = fopen(fname, "w");
+    if (f == NULL) {
+        die("failed to open %s: %s", fname, strerror(errno));
+    }
+
+    unsigned char hdr[REPLAY_HEADER_SIZE];
+    memcpy(hdr, REPLAY_MAGIC, 4);
+    hdr[4] = REPLAY_VERSION;
+    for (int i = 0; i < 4; i++) {
+        hdr[5 + i] = (uint32_t) r->level >> (i * 8);
+    }
+    for (int i = 0; i < 8; i++) {
+        hdr[9 + i] = r->seed >> (i * 8);
+    }
+    fwrite(hdr, 1, sizeof(hdr), f);
+
+    for (int i = 0; i < r->nruns; i++) {
+        unsigned char run[6];
+        int n = 0;
+        uint32_t v = r->runs[i].n;
+        do {
+            run[n] = v & 0x7f;
+            v >>= 7;
+            if (v != 0) {
+                run[n] |= 0x80;
+            }
+            n++;
+        } while (v != 0);
+        run[n++] = r->runs[i].key;
+        fwrite(run, 1, n, f);
+    }
+
+    if (ferror(f) || fclose(f) != 0) {
+        die("failed to write %s: %s", fname, strerror(errno));
+    }
+}
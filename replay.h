@@ -0,0 +1,44 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "key.h"
+
+/*
+ * Keys pressed during a game session. Together with the starting level and
+ * RNG seed it is enough to reproduce the whole session exactly.
+ * Keys are stored run-length encoded since the same key is usually held
+ * for many ticks.
+ */
+struct replay_run {
+    // Number of ticks key is pressed for.
+    uint32_t n;
+    enum key key;
+};
+
+struct replay {
+    int level;
+    uint64_t seed;
+    struct replay_run *runs;
+    int nruns;
+    int cap;
+    // Playback position: current run and ticks already played from it.
+    int run;
+    uint32_t played;
+};
+
+struct replay *replay_init(int level, uint64_t seed);
+void replay_destroy(struct replay *r);
+void replay_record(struct replay *r, enum key k);
+bool replay_next(struct replay *r, enum key *k);
+bool replay_done(struct replay *r);
+void replay_rewind(struct replay *r);
+long replay_ticks(struct replay *r);
+bool replay_is(const char *buf, size_t len);
+struct replay *replay_parse(const char *buf, size_t len);
+struct replay *replay_load(char *fname);
+void replay_save(struct replay *r, char *fname);
+
+#endif /* REPLAY_H_ */
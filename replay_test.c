@@ -0,0 +1,115 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "arena.h"
+#include "exit.h"
+#include "game.h"
+#include "key.h"
+#include "level.h"
+#include "replay.h"
+
+// Replay playback test. Records a session which ends exactly on the tick
+// the level is won, then plays it back the way lr-batch does and checks
+// the playback stops on the won level instead of going on to the next one.
+
+// Runner picks up the gold to the right, walks back to the ladder and
+// climbs out of the map.
+static const char *LEVEL =
+    " H\n"
+    " H\n"
+    " H\n"
+    " H\n"
+    " H\n"
+    " H\n"
+    " H\n"
+    " H\n"
+    " H\n"
+    " H\n"
+    " H\n"
+    " H\n"
+    " H\n"
+    " H\n"
+    " H&$\n"
+    "@@@@@@@@@@@@@@@@@@@@@@@@@@@@\n";
+
+#define MAX_TICKS 10000
+
+// Key a player presses to win the level from the current game state.
+static enum key play(struct game *game)
+{
+    struct runner *r = &game->runner;
+
+    if (game->state != GSTATE_RUN) {
+        return KEY_ANY;
+    }
+    if (r->ngold < game->ngold) {
+        return KEY_RIGHT;
+    }
+    if (r->x > 1 || r->tx > 0) {
+        return KEY_LEFT;
+    }
+
+    return KEY_UP;
+}
+
+static struct game *load(struct arena *a, uint64_t seed)
+{
+    char err[128];
+    struct level *lvl = level_parse(1, LEVEL, strlen(LEVEL), err,
+        sizeof(err), a);
+    if (lvl == NULL) {
+        die("invalid test level: %s", err);
+    }
+
+    return game_init(lvl, seed, NULL, a);
+}
+
+int main()
+{
+    struct arena *arena = arena_init(GAME_ARENA_SIZE);
+
+    // Record the session until the won level ends.
+    struct replay *r = replay_init(1, 1);
+    struct game *game = load(arena, r->seed);
+    long recorded = 0;
+    for (bool end = false; !end; recorded++) {
+        if (recorded == MAX_TICKS) {
+            die("level is not won in %d ticks", MAX_TICKS);
+        }
+        enum key k = play(game);
+        replay_record(r, k);
+        end = game_tick(game, k);
+    }
+    if (!game->won) {
+        die("runner died while recording");
+    }
+    uint64_t hash = game_hash(game);
+
+    // Play it back: the level is won on the last key, so the session
+    // is over there.
+    arena_reset(arena);
+    game = load(arena, r->seed);
+    long played = 0;
+    enum key k;
+    while (replay_next(r, &k)) {
+        played++;
+        if (replay_done(r) != (played == recorded)) {
+            die("replay is %sdone after %ld of %ld ticks",
+                replay_done(r) ? "" : "not ", played, recorded);
+        }
+        if (game_tick(game, k)) {
+            break;
+        }
+    }
+    if (played != recorded || !game->won || game_hash(game) != hash) {
+        die("playback differs: %ld of %ld ticks, won %d", played, recorded,
+            game->won);
+    }
+
+    printf("replay: won in %ld ticks\n", played);
+
+    replay_destroy(r);
+    arena_destroy(arena);
+
+    return 0;
+}
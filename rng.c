@@ -0,0 +1,27 @@
+#include "rng.h"
+
+/*
+ * Initialize generator state. Seed is scrambled with splitmix64 so close
+ * seeds (like 1, 2, 3, ...) produce unrelated sequences.
+ */
+void rng_seed(struct rng *r, uint64_t seed)
+{
+    uint64_t z = seed + 0x9e3779b97f4a7c15;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    z = z ^ (z >> 31);
+    // xorshift state must never be zero.
+    r->s = z != 0 ? z : 0x9e3779b97f4a7c15;
+}
+
+/*
+ * Return next 32-bit pseudo random number.
+ */
+uint32_t rng_next(struct rng *r)
+{
+    r->s ^= r->s >> 12;
+    r->s ^= r->s << 25;
+    r->s ^= r->s >> 27;
+
+    return (r->s * 0x2545f4914f6cdd1d) >> 32;
+}
@@ -0,0 +1,18 @@
+#ifndef RNG_H_
+#define RNG_H_
+
+#include <stdint.h>
+
+/*
+ * Small seedable pseudo random numbers generator (xorshift64*).
+ * Every game owns its own generator so games are reproducible and
+ * independent from each other.
+ */
+struct rng {
+    uint64_t s;
+};
+
+void rng_seed(struct rng *r, uint64_t seed);
+uint32_t rng_next(struct rng *r);
+
+#endif /* RNG_H_ */
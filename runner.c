@@ -3,44 +3,15 @@
 #include "runner.h"
 #include "texture.h"
 #include "tile.h"
-#include "xmalloc.h"
 
-struct runner *runner_init()
+void runner_init(struct runner *r)
 {
-    struct runner *r = xmalloc(sizeof(struct runner));
     r->sx = 0;
     r->sy = 0;
-    r->lefta = animation_init(ANIMATION_RUNNER_LEFT);
-    r->righta = animation_init(ANIMATION_RUNNER_RIGHT);
-    r->updowna = animation_init(ANIMATION_RUNNER_UPDOWN);
-    r->climblefta = animation_init(ANIMATION_RUNNER_CLIMB_LEFT);
-    r->climbrighta = animation_init(ANIMATION_RUNNER_CLIMB_RIGHT);
-    r->diglefta = animation_init(ANIMATION_RUNNER_DIG_LEFT);
-    r->digrighta = animation_init(ANIMATION_RUNNER_DIG_RIGHT);
-    r->falllefta = animation_init(ANIMATION_RUNNER_FALL_LEFT);
-    r->fallrighta = animation_init(ANIMATION_RUNNER_FALL_RIGHT);
-    r->holelefta = animation_init(ANIMATION_RUNNER_HOLE_LEFT);
-    r->holerighta = animation_init(ANIMATION_RUNNER_HOLE_RIGHT);
+    r->ngold = 0;
+    animation_init(&r->holea, ANIMATION_RUNNER_HOLE_RIGHT);
 
     runner_reset(r);
-
-    return r;
-}
-
-void runner_destroy(struct runner *r)
-{
-    animation_destroy(r->lefta);
-    animation_destroy(r->righta);
-    animation_destroy(r->updowna);
-    animation_destroy(r->climblefta);
-    animation_destroy(r->climbrighta);
-    animation_destroy(r->diglefta);
-    animation_destroy(r->digrighta);
-    animation_destroy(r->falllefta);
-    animation_destroy(r->fallrighta);
-    animation_destroy(r->holelefta);
-    animation_destroy(r->holerighta);
-    free(r);
 }
 
 void runner_reset(struct runner *r)
@@ -49,31 +20,31 @@ void runner_reset(struct runner *r)
     r->y = r->sy;
     r->tx = 0;
     r->ty = 0;
-    r->cura = r->righta;
+    animation_init(&r->cura, ANIMATION_RUNNER_RIGHT);
     r->state = RSTATE_RIGHT;
 }
 
-struct animation *runner_state_animation(struct runner *r, enum runner_state s)
+enum animation_t runner_state_animation(enum runner_state s)
 {
     switch (s) {
     case RSTATE_DIG_LEFT:
-        return r->diglefta;
+        return ANIMATION_RUNNER_DIG_LEFT;
     case RSTATE_CLIMB_LEFT:
-        return r->climblefta;
+        return ANIMATION_RUNNER_CLIMB_LEFT;
     case RSTATE_CLIMB_RIGHT:
-        return r->climbrighta;
+        return ANIMATION_RUNNER_CLIMB_RIGHT;
     case RSTATE_DIG_RIGHT:
-        return r->digrighta;
+        return ANIMATION_RUNNER_DIG_RIGHT;
     case RSTATE_FALL_LEFT:
-        return r->falllefta;
+        return ANIMATION_RUNNER_FALL_LEFT;
     case RSTATE_FALL_RIGHT:
-        return r->fallrighta;
+        return ANIMATION_RUNNER_FALL_RIGHT;
     case RSTATE_LEFT:
-        return r->lefta;
+        return ANIMATION_RUNNER_LEFT;
     case RSTATE_RIGHT:
-        return r->righta;
+        return ANIMATION_RUNNER_RIGHT;
     case RSTATE_UPDOWN:
-        return r->updowna;
+        return ANIMATION_RUNNER_UPDOWN;
     default:
         die("illegal state");
     }
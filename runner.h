@@ -1,6 +1,8 @@
 #ifndef RUNNER_H_
 #define RUNNER_H_
 
+#include "animation.h"
+
 enum runner_state {
     RSTATE_CLIMB_LEFT,
     RSTATE_CLIMB_RIGHT,
@@ -15,13 +17,13 @@ enum runner_state {
 };
 
 struct runner {
-    // Start X (0..MAP_WIDTH) position on the map.
+    // Start X (0..map width) position on the map.
     int sx;
-    // Start Y (0..MAP_HEIGHT) position on the map.
+    // Start Y (0..map height) position on the map.
     int sy;
-    // Current X (0..MAP_WIDTH) position on the map.
+    // Current X (0..map width) position on the map.
     int x;
-    // Current Y (0..MAP_HEIGHT) position on the map.
+    // Current Y (0..map height) position on the map.
     int y;
     // X offset in the current map tile. When runner moves to the second
     // half of the current tile it is transfered to the next tile. To keep
@@ -29,31 +31,10 @@ struct runner {
     int tx;
     // Same as tx but for vertical movement: falls and ladders.
     int ty;
-    // "Move left" animation.
-    struct animation *lefta;
-    // "Move right" animation.
-    struct animation *righta;
-    // Combined "move up" and "move down" animation.
-    struct animation *updowna;
-    // Rope climbing left animation.
-    struct animation *climblefta;
-    // Rope climbing right animation.
-    struct animation *climbrighta;
-    // Runner digging hole on the left of the runner.
-    struct animation *diglefta;
-    // Runner digging hole on the right of the runner.
-    struct animation *digrighta;
-    // Looking left runner falling down.
-    struct animation *falllefta;
-    // Looking right runner falling down.
-    struct animation *fallrighta;
-    // Hole on the left of the runner.
-    struct animation *holelefta;
-    // Hole on the right of the runner.
-    struct animation *holerighta;
-    // Currently active animation. Points to one of animations like lefta,
-    // righta, updowna, ...
-    struct animation *cura;
+    // Currently active animation.
+    struct animation cura;
+    // Hole animation displayed next to the runner while digging.
+    struct animation holea;
     // Runner state defines is it moving left/right, falling, etc.
     enum runner_state state;
     // Number of picked up gold items. If this number is equals to the number
@@ -61,9 +42,8 @@ struct runner {
     int ngold;
 };
 
-struct runner *runner_init();
-void runner_destroy(struct runner *r);
+void runner_init(struct runner *r);
 void runner_reset(struct runner *r);
-struct animation *runner_state_animation(struct runner *r, enum runner_state s);
+enum animation_t runner_state_animation(enum runner_state s);
 
 #endif /* RUNNER_H_ */
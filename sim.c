@@ -0,0 +1,132 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ai.h"
+#include "arena.h"
+#include "exit.h"
+#include "game.h"
+#include "key.h"
+#include "level.h"
+#include "pool.h"
+
+// Headless game simulator. Plays a level for the given number of ticks
+// feeding scripted keys into game_tick() as fast as the CPU allows and
+// reports simulation speed. Level is restarted every time the game ends.
+
+#define DEFAULT_TICKS 100000
+#define DEFAULT_KEYS "a"
+
+static void usage()
+{
+    fprintf(stderr, "usage: lr-sim [-a ai] [-j n] [-n ticks] [-s seed] "
+        "[-k keys] level\n"
+        "  -a ai     guards AI: scan or flow (default scan)\n"
+        "  -j n      look for guards' moves on n threads in parallel\n"
+        "  -n ticks  number of game ticks to simulate (default %d)\n"
+        "  -s seed   random numbers generator seed (default 1)\n"
+        "  -k keys   keys script, one character per tick, repeated:\n"
+        "            . none, a any, l left, r right, u up, d down,\n"
+        "            z dig left, x dig right (default \"%s\")\n",
+        DEFAULT_TICKS, DEFAULT_KEYS);
+    exit(EXIT_FAILURE);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    long ticks = DEFAULT_TICKS;
+    uint64_t seed = 1;
+    char *script = DEFAULT_KEYS;
+    int mode = AI_MODE_SCAN;
+    int nthreads = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:j:n:s:k:")) != -1) {
+        switch (opt) {
+        case 'a':
+            mode = ai_mode_parse(optarg);
+            break;
+        case 'j':
+            nthreads = atoi(optarg);
+            if (nthreads <= 0) {
+                usage();
+            }
+            break;
+        case 'n':
+            ticks = atol(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'k':
+            script = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1 || ticks <= 0 || mode == -1) {
+        usage();
+    }
+    struct game_opts opts = {mode, NULL};
+    if (nthreads > 0) {
+        opts.pool = pool_init(nthreads);
+    }
+    int n = atoi(argv[optind]);
+
+    enum key *keys;
+    int nkeys = key_script(script, strlen(script), &keys);
+    if (nkeys <= 0) {
+        die("invalid keys script");
+    }
+
+    // Level is loaded once, games restarted on it are created in the arena.
+    struct level *lvl = level_init(n, NULL);
+    struct arena *arena = arena_init(GAME_ARENA_SIZE);
+    struct game *game = game_init(lvl, seed, &opts, arena);
+    long games = 1;
+    long won = 0;
+
+    double start = now();
+    for (long i = 0; i < ticks; i++) {
+        if (game_tick(game, keys[i % nkeys])) {
+            if (game->won) {
+                won++;
+            }
+            arena_reset(arena);
+            game = game_init(lvl, seed, &opts, arena);
+            games++;
+        }
+    }
+    double elapsed = now() - start;
+    uint64_t hash = game_hash(game);
+
+    size_t high = arena_high(arena);
+
+    arena_destroy(arena);
+    level_destroy(lvl);
+    free(keys);
+    if (opts.pool != NULL) {
+        pool_destroy(opts.pool);
+    }
+
+    printf("level: %d\n", n);
+    printf("ticks: %ld\n", ticks);
+    printf("games: %ld (won %ld)\n", games, won);
+    printf("time: %.3fs\n", elapsed);
+    printf("ticks/sec: %.0f\n", ticks / elapsed);
+    printf("arena: %zu bytes\n", high);
+    printf("hash: %016llx\n", (unsigned long long) hash);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "exit.h"
+#include "game.h"
+#include "key.h"
+#include "level.h"
+#include "pool.h"
+#include "xmalloc.h"
+
+// Game snapshot test. Saves games of a classic and a large level in the
+// middle of play, plays on, restores them and checks the game goes on
+// exactly as before. Hash of the game must depend only on its state: not
+// on where the game lives or what options outside of the state it has, and
+// it must not change between builds unless the rules do.
+
+#define TICKS 2000
+// Tick the game is saved at, both games are still running then.
+#define SAVE_TICK 100
+#define KEYS "arrrrrrrzlllllllxuuuudddrrrrrrrrrrllll"
+
+// Classic level: runner, a few guards and gold, bricks to dig.
+static const char *CLASSIC =
+    "      H      $       H\n"
+    "      H   0          H\n"
+    "######H#######-------H\n"
+    "      H              H\n"
+    "  $   H     0     $  H\n"
+    "##############H######H\n"
+    "              H      H\n"
+    "   0          H   &  H\n"
+    "@@@@@@@@@@@@@@@@@@@@@@\n";
+
+// Hash of the classic level's game when it is over or after TICKS ticks of
+// KEYS with seed 1. It changes only when the rules of the game or the hash
+// itself do.
+#define CLASSIC_HASH 0x1dbd89917eaa42fb
+
+static void noop_phase(void *arg, enum game_phase phase)
+{
+    (void) arg;
+    (void) phase;
+}
+
+// Large level with many guards, its map arrays are bigger than classic.
+static struct level *large()
+{
+    static char buf[MAP_MAX_HEIGHT * (MAP_MAX_WIDTH + 1) + 1];
+    char *b = buf;
+    int nguards = 0;
+
+    for (int y = 0; y < MAP_MAX_HEIGHT; y++) {
+        for (int x = 0; x < MAP_MAX_WIDTH; x++) {
+            char c = ' ';
+            if (y == MAP_MAX_HEIGHT - 1) {
+                c = '@';
+            } else if (x % 12 == 3) {
+                c = 'H';
+            } else if (y % 4 == 3) {
+                c = '#';
+            } else if (y % 8 == 2 && x % 3 == 0 && nguards < 100) {
+                c = '0';
+                nguards++;
+            } else if (y % 16 == 6 && x % 20 == 10) {
+                c = '$';
+            } else if (y == MAP_MAX_HEIGHT - 2 && x == 40) {
+                c = '&';
+            }
+            *b++ = c;
+        }
+        *b++ = '\n';
+    }
+    *b = '\0';
+
+    char err[128];
+    struct level *lvl = level_parse(2, buf, strlen(buf), err, sizeof(err),
+        NULL);
+    if (lvl == NULL) {
+        die("invalid large level: %s", err);
+    }
+
+    return lvl;
+}
+
+static enum key key_at(int tick)
+{
+    return key_parse(KEYS[tick % (sizeof(KEYS) - 1)]);
+}
+
+// Play ticks [from, to) and store hash after every tick into hashes.
+// Returns the tick after the one the game is over at, to if it is not.
+static int play(struct game *game, int from, int to, uint64_t *hashes)
+{
+    for (int i = from; i < to; i++) {
+        bool end = game_tick(game, key_at(i));
+        hashes[i] = game_hash(game);
+        if (end) {
+            return i + 1;
+        }
+    }
+
+    return to;
+}
+
+static void test_restore(struct level *lvl, const char *name)
+{
+    static uint64_t first[TICKS];
+    static uint64_t second[TICKS];
+
+    struct game *game = game_init(lvl, 1, NULL, NULL);
+    // Snapshot gets exactly the game's size, not the largest game's one.
+    struct game *snapshot = xmalloc(game_size(game));
+    if (game_size(game) > game_max_size()) {
+        die("%s: game is larger than the largest one", name);
+    }
+
+    if (play(game, 0, SAVE_TICK, first) != SAVE_TICK) {
+        die("%s: game is over before it is saved", name);
+    }
+    game_snapshot(game, snapshot);
+    uint64_t saved = game_hash(snapshot);
+    if (saved != first[SAVE_TICK - 1]) {
+        die("%s: snapshot hash differs", name);
+    }
+    int end = play(game, SAVE_TICK, TICKS, first);
+
+    game_restore(game, snapshot);
+    if (game_hash(game) != saved) {
+        die("%s: restored hash differs", name);
+    }
+    if (play(game, SAVE_TICK, TICKS, second) != end) {
+        die("%s: game is over at another tick after restore", name);
+    }
+    for (int i = SAVE_TICK; i < end; i++) {
+        if (first[i] != second[i]) {
+            die("%s: tick %d differs after restore", name, i);
+        }
+    }
+    // Snapshot is not touched by playing the restored game.
+    if (game_hash(snapshot) != saved) {
+        die("%s: snapshot has changed", name);
+    }
+
+    free(snapshot);
+    game_destroy(game);
+}
+
+// Games in different memory with different options outside of the state
+// hash the same.
+static void test_hash(struct level *lvl, const char *name)
+{
+    struct pool *pool = pool_init(2);
+    struct game_opts opts = {AI_MODE_SCAN, pool, noop_phase, NULL};
+    struct arena *arena = arena_init(GAME_ARENA_SIZE);
+    struct game *a = game_init(lvl, 1, NULL, NULL);
+    struct game *b = game_init(lvl, 1, &opts, arena);
+
+    for (int i = 0; i < TICKS; i++) {
+        bool enda = game_tick(a, key_at(i));
+        bool endb = game_tick(b, key_at(i));
+        if (enda != endb || game_hash(a) != game_hash(b)) {
+            die("%s: tick %d: hash depends on memory or options", name, i);
+        }
+        if (enda) {
+            break;
+        }
+    }
+
+    game_destroy(a);
+    arena_destroy(arena);
+    pool_destroy(pool);
+}
+
+int main()
+{
+    char err[128];
+    struct level *classic = level_parse(1, CLASSIC, strlen(CLASSIC), err,
+        sizeof(err), NULL);
+    if (classic == NULL) {
+        die("invalid classic level: %s", err);
+    }
+    struct level *big = large();
+
+    test_restore(classic, "classic");
+    test_restore(big, "large");
+    test_hash(classic, "classic");
+    test_hash(big, "large");
+
+    struct game *game = game_init(classic, 1, NULL, NULL);
+    static uint64_t hashes[TICKS];
+    int end = play(game, 0, TICKS, hashes);
+    if (hashes[end - 1] != CLASSIC_HASH) {
+        die("classic hash is %016llx instead of %016llx",
+            (unsigned long long) hashes[end - 1],
+            (unsigned long long) CLASSIC_HASH);
+    }
+    game_destroy(game);
+
+    level_destroy(classic);
+    level_destroy(big);
+
+    printf("snapshot: restored games play the same, hash %016llx\n",
+        (unsigned long long) CLASSIC_HASH);
+
+    return 0;
+}
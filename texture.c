@@ -3,11 +3,37 @@
 #include "exit.h"
 #include "level.h"
 #include "path.h"
+#include "render.h"
 #include "texture.h"
 
 #define TEXTURES_DIR "./textures"
+// Width of the atlas all game textures are packed into.
+#define ATLAS_WIDTH 1024
+// Gap between textures in the atlas, prevents neighbour textures from
+// bleeding into each other when scaled with linear filtering.
+#define ATLAS_PADDING 1
 
-static SDL_Texture *textures[TEXTURE_SIZE] = {NULL};
+// Texture images by texture id, NULL for textures without image.
+static char *texture_files[TEXTURE_SIZE] = {
+    [TEXTURE_BRICK] = "brick.png",
+    [TEXTURE_GOLD] = "gold.png",
+    [TEXTURE_GROUND] = "ground.png",
+    [TEXTURE_GUARD] = "guard.png",
+    [TEXTURE_HOLE] = "hole.png",
+    [TEXTURE_LADDER] = "ladder.png",
+    [TEXTURE_ROPE] = "rope.png",
+    [TEXTURE_RUNNER] = "runner.png",
+    [TEXTURE_SOLID] = "solid.png",
+    [TEXTURE_TEXT] = "text.png",
+};
+
+// All game textures are packed into the single atlas texture, so a whole
+// frame can be drawn with a single draw call. Every texture is a region
+// of the atlas.
+static SDL_Texture *atlas = NULL;
+static int atlas_w = 0;
+static int atlas_h = 0;
+static SDL_Rect rects[TEXTURE_SIZE];
 
 /*
  * Load texture image from file.
@@ -26,32 +52,110 @@ SDL_Texture *texture_load(SDL_Renderer *renderer, char *file)
     return texture;
 }
 
-void texture_init(SDL_Renderer *renderer)
+static SDL_Surface *surface_load(char *file)
 {
-    textures[TEXTURE_BRICK] = texture_load(renderer, "brick.png");
-    textures[TEXTURE_EMPTY] = NULL;
-    textures[TEXTURE_GOLD] = texture_load(renderer, "gold.png");
-    textures[TEXTURE_GUARD] = texture_load(renderer, "guard.png");
-    // texture_map[TILE_HLADDER] = texture_load(renderer, ".png");
-    textures[TEXTURE_HOLE] = texture_load(renderer, "hole.png");
-    textures[TEXTURE_LADDER] = texture_load(renderer, "ladder.png");
-    textures[TEXTURE_ROPE] = texture_load(renderer, "rope.png");
-    textures[TEXTURE_RUNNER] = texture_load(renderer, "runner.png");
-    textures[TEXTURE_SOLID] = texture_load(renderer, "solid.png");
-    // texture_map[TILE_TRAP] = texture_load(renderer, ".png");
-    textures[TEXTURE_GROUND] = texture_load(renderer, "ground.png");
-    textures[TEXTURE_TEXT] = texture_load(renderer, "text.png");
+    char *path = path_join(TEXTURES_DIR, file);
+    SDL_Surface *img = IMG_Load(path);
+    free(path);
+
+    if (img == NULL) {
+        die("failed to load texture: %s", IMG_GetError());
+    }
+    SDL_Surface *s = SDL_ConvertSurfaceFormat(img, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(img);
+    if (s == NULL) {
+        die("failed to convert texture %s: %s", file, SDL_GetError());
+    }
+
+    return s;
 }
 
-void texture_destroy()
+/*
+ * Load all game textures and pack them into the atlas. Textures are placed
+ * left to right in shelves.
+ */
+void texture_init(SDL_Renderer *renderer)
 {
+    SDL_Surface *images[TEXTURE_SIZE] = {NULL};
+    int x = 0;
+    int y = 0;
+    int shelf = 0;
+
     for (int i = 0; i < TEXTURE_SIZE; i++) {
-        SDL_DestroyTexture(textures[i]);
-        textures[i] = NULL;
+        rects[i] = (SDL_Rect) {0, 0, 0, 0};
+        if (texture_files[i] == NULL) {
+            continue;
+        }
+
+        SDL_Surface *s = surface_load(texture_files[i]);
+        if (s->w > ATLAS_WIDTH) {
+            die("texture %s is too wide for atlas", texture_files[i]);
+        }
+        if (x + s->w > ATLAS_WIDTH) {
+            x = 0;
+            y += shelf + ATLAS_PADDING;
+            shelf = 0;
+        }
+        rects[i] = (SDL_Rect) {x, y, s->w, s->h};
+        images[i] = s;
+        x += s->w + ATLAS_PADDING;
+        if (s->h > shelf) {
+            shelf = s->h;
+        }
+    }
+    atlas_w = ATLAS_WIDTH;
+    atlas_h = y + shelf;
+
+    SDL_Surface *a = SDL_CreateRGBSurfaceWithFormat(0, atlas_w, atlas_h, 32,
+        SDL_PIXELFORMAT_RGBA32);
+    if (a == NULL) {
+        die_sdl("SDL_CreateRGBSurfaceWithFormat");
     }
+    SDL_FillRect(a, NULL, SDL_MapRGBA(a->format, 0, 0, 0, 0));
+    for (int i = 0; i < TEXTURE_SIZE; i++) {
+        if (images[i] == NULL) {
+            continue;
+        }
+        // Copy pixels as is including alpha channel.
+        SDL_SetSurfaceBlendMode(images[i], SDL_BLENDMODE_NONE);
+        if (SDL_BlitSurface(images[i], NULL, a, &rects[i]) < 0) {
+            die_sdl("SDL_BlitSurface");
+        }
+        SDL_FreeSurface(images[i]);
+    }
+
+    atlas = SDL_CreateTextureFromSurface(renderer, a);
+    SDL_FreeSurface(a);
+    if (atlas == NULL) {
+        die_sdl("SDL_CreateTextureFromSurface");
+    }
+    SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
 }
 
-SDL_Texture *texture_get(enum texture t)
+void texture_destroy()
+{
+    SDL_DestroyTexture(atlas);
+    atlas = NULL;
+}
+
+/*
+ * Return atlas texture all game textures are packed into.
+ */
+SDL_Texture *texture_atlas()
+{
+    return atlas;
+}
+
+void texture_atlas_size(int *w, int *h)
+{
+    *w = atlas_w;
+    *h = atlas_h;
+}
+
+/*
+ * Return region of the atlas texture t is stored in.
+ */
+struct SDL_Rect *texture_rect(enum texture t)
 {
-    return textures[t];
+    return &rects[t];
 }
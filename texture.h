@@ -1,8 +1,6 @@
 #ifndef TEXTURE_H_
 #define TEXTURE_H_
 
-#include <SDL.h>
-
 enum texture {
     TEXTURE_BRICK,
     TEXTURE_EMPTY,
@@ -21,9 +19,17 @@ enum texture {
     TEXTURE_SIZE,
 };
 
-SDL_Texture *texture_load(SDL_Renderer *renderer, char *file);
-void texture_init(SDL_Renderer *renderer);
+// Texture identifiers are used by the game core which is built without SDL,
+// so SDL types are only forward declared here.
+struct SDL_Rect;
+struct SDL_Renderer;
+struct SDL_Texture;
+
+struct SDL_Texture *texture_load(struct SDL_Renderer *renderer, char *file);
+void texture_init(struct SDL_Renderer *renderer);
 void texture_destroy();
-SDL_Texture *texture_get(enum texture t);
+struct SDL_Texture *texture_atlas();
+void texture_atlas_size(int *w, int *h);
+struct SDL_Rect *texture_rect(enum texture t);
 
 #endif /* TEXTURE_H_ */
@@ -0,0 +1,96 @@
+#include "exit.h"
+#include "timer.h"
+
+/*
+ * Initialize wheel of n timers stored in array t. Array must follow the
+ * wheel in the same allocation, see struct timers.
+ */
+void timers_init(struct timers *w, struct timer *t, int n)
+{
+    w->now = 0;
+    w->t = (unsigned char *) t - (unsigned char *) w;
+    for (int i = 0; i < TIMER_SLOTS; i++) {
+        w->slots[i] = TIMER_NONE;
+    }
+    for (int i = 0; i < n; i++) {
+        t[i].next = i + 1 < n ? i + 1 : TIMER_NONE;
+    }
+    w->free = n > 0 ? 0 : TIMER_NONE;
+}
+
+/*
+ * Move to the next tick.
+ */
+void timers_tick(struct timers *w)
+{
+    w->now++;
+}
+
+/*
+ * Start timer of the given type expiring delay ticks later. Returns timer's
+ * id. Calls die() if there are too many timers.
+ */
+int timer_add(struct timers *w, int delay, enum timer_type type, int x,
+    int y)
+{
+    int id = w->free;
+    if (id == TIMER_NONE) {
+        die("timers limit exceeded");
+    }
+    struct timer *t = timer_get(w, id);
+    w->free = t->next;
+
+    t->due = w->now + delay;
+    t->type = type;
+    t->x = x;
+    t->y = y;
+    int16_t *slot = &w->slots[t->due % TIMER_SLOTS];
+    t->prev = TIMER_NONE;
+    t->next = *slot;
+    if (*slot != TIMER_NONE) {
+        timer_get(w, *slot)->prev = id;
+    }
+    *slot = id;
+
+    return id;
+}
+
+/*
+ * Stop timer which has not expired yet.
+ */
+void timer_cancel(struct timers *w, int id)
+{
+    struct timer *t = timer_get(w, id);
+
+    if (t->prev != TIMER_NONE) {
+        timer_get(w, t->prev)->next = t->next;
+    } else {
+        w->slots[t->due % TIMER_SLOTS] = t->next;
+    }
+    if (t->next != TIMER_NONE) {
+        timer_get(w, t->next)->prev = t->prev;
+    }
+    t->next = w->free;
+    w->free = id;
+}
+
+/*
+ * Look for the timer of the given type expiring at the current tick. If
+ * there is one it is removed, its coordinates are stored into x:y and
+ * true is returned.
+ */
+bool timer_expired(struct timers *w, enum timer_type type, int *x, int *y)
+{
+    int id = w->slots[w->now % TIMER_SLOTS];
+    for (; id != TIMER_NONE; id = timer_get(w, id)->next) {
+        struct timer *t = timer_get(w, id);
+        if (t->due == w->now && t->type == type) {
+            *x = t->x;
+            *y = t->y;
+            timer_cancel(w, id);
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,68 @@
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Number of wheel slots, power of two. Timers longer than the wheel just
+// stay in their slot for extra turns.
+#define TIMER_SLOTS 256
+// Index of no timer.
+#define TIMER_NONE -1
+
+// Timed game events.
+enum timer_type {
+    // Guard is born again and starts falling, x is guard's index.
+    TIMER_GUARD_REBORN,
+    // Guard starts climbing out of the hole, x is guard's index.
+    TIMER_GUARD_TRAP,
+    // Hole at x:y is refilled.
+    TIMER_HOLE_FILL,
+};
+
+struct timer {
+    // Tick the timer expires at.
+    uint32_t due;
+    // Timer type, enum timer_type.
+    uint8_t type;
+    int16_t x;
+    int16_t y;
+    // Neighbours in the slot's list or in the free list.
+    int16_t prev;
+    int16_t next;
+};
+
+/*
+ * Timer wheel: timers are hashed into slots by the tick they expire at, so
+ * only timers of the current slot are looked at on every tick.
+ * Timers themselves are stored in an array sized by the wheel's owner in
+ * the same allocation. It is referred to by its offset from the wheel, so
+ * the wheel is plain old data and can be copied freely together with it.
+ */
+struct timers {
+    // Current tick.
+    uint32_t now;
+    // First timer of every slot.
+    int16_t slots[TIMER_SLOTS];
+    // First unused timer.
+    int16_t free;
+    // Offset of the timers array from the wheel, see timers_init().
+    uint32_t t;
+};
+
+/*
+ * Return timer number id of the wheel.
+ */
+static inline struct timer *timer_get(struct timers *w, int id)
+{
+    return (struct timer *) ((unsigned char *) w + w->t) + id;
+}
+
+void timers_init(struct timers *w, struct timer *t, int n);
+void timers_tick(struct timers *w);
+int timer_add(struct timers *w, int delay, enum timer_type type, int x,
+    int y);
+void timer_cancel(struct timers *w, int id);
+bool timer_expired(struct timers *w, enum timer_type type, int *x, int *y);
+
+#endif /* TIMER_H_ */
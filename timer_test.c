@@ -0,0 +1,133 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "exit.h"
+#include "rng.h"
+#include "timer.h"
+
+// Timer wheel test. Adds and cancels random timers with delays shorter and
+// longer than the wheel and checks every tick the wheel expires exactly the
+// timers a plain list of them says are due. A copy of the wheel taken
+// halfway has to play the rest the same way.
+
+#define NTIMERS 64
+#define MAX_DELAY (3 * TIMER_SLOTS)
+#define TICKS 20000
+
+// Wheel with its timers in the same allocation, as struct game has it.
+struct wheel {
+    struct timers w;
+    struct timer t[NTIMERS];
+};
+
+// Expected state of a timer.
+struct model {
+    bool active;
+    uint32_t due;
+    enum timer_type type;
+    int x;
+    int y;
+};
+
+static struct wheel wheel;
+static struct wheel copy;
+static struct model models[NTIMERS];
+static struct model copies[NTIMERS];
+
+// Check the wheel expires exactly the due timers of the model at the
+// current tick.
+static void check_tick(struct timers *w, struct model *m)
+{
+    for (int type = TIMER_GUARD_REBORN; type <= TIMER_HOLE_FILL; type++) {
+        int x, y;
+        while (timer_expired(w, type, &x, &y)) {
+            int id = x;
+            if (id < 0 || id >= NTIMERS || !m[id].active
+                || m[id].due != w->now || m[id].type != (int) type
+                || m[id].y != y) {
+                die("tick %u: unexpected timer %d of type %d", w->now, id,
+                    type);
+            }
+            m[id].active = false;
+        }
+    }
+    for (int i = 0; i < NTIMERS; i++) {
+        if (m[i].active && m[i].due == w->now) {
+            die("tick %u: timer %d has not expired", w->now, i);
+        }
+    }
+}
+
+int main()
+{
+    struct rng rng;
+    rng_seed(&rng, 1);
+    timers_init(&wheel.w, wheel.t, NTIMERS);
+    // Timers' ids used by the test, x of every timer is its id.
+    int ids[NTIMERS];
+    for (int i = 0; i < NTIMERS; i++) {
+        ids[i] = TIMER_NONE;
+    }
+
+    long added = 0;
+    long cancelled = 0;
+    for (int tick = 0; tick < TICKS; tick++) {
+        timers_tick(&wheel.w);
+        check_tick(&wheel.w, models);
+        for (int i = 0; i < NTIMERS; i++) {
+            if (!models[i].active) {
+                ids[i] = TIMER_NONE;
+            }
+        }
+
+        int i = rng_next(&rng) % NTIMERS;
+        if (ids[i] == TIMER_NONE) {
+            int delay = 1 + rng_next(&rng) % MAX_DELAY;
+            enum timer_type type = rng_next(&rng) % (TIMER_HOLE_FILL + 1);
+            int y = rng_next(&rng) % 100;
+            // The test names timers by x, the wheel by ids.
+            int id = timer_add(&wheel.w, delay, type, i, y);
+            if (id < 0 || id >= NTIMERS) {
+                die("timer_add returned %d", id);
+            }
+            ids[i] = id;
+            models[i] = (struct model) {true, wheel.w.now + delay, type, i,
+                y};
+            added++;
+        } else if (rng_next(&rng) % 4 == 0) {
+            timer_cancel(&wheel.w, ids[i]);
+            ids[i] = TIMER_NONE;
+            models[i].active = false;
+            cancelled++;
+        }
+
+        // Wheel is plain old data: its copy goes on by itself.
+        if (tick == TICKS / 2) {
+            memcpy(&copy, &wheel, sizeof(wheel));
+            memcpy(copies, models, sizeof(models));
+        }
+    }
+
+    // Play the copy with no more timers added until all of them expire.
+    for (int tick = 0; tick <= MAX_DELAY; tick++) {
+        timers_tick(&copy.w);
+        check_tick(&copy.w, copies);
+    }
+    for (int i = 0; i < NTIMERS; i++) {
+        if (copies[i].active) {
+            die("copy: timer %d has not expired", i);
+        }
+    }
+
+    // All timers are free again.
+    for (int i = 0; i < NTIMERS; i++) {
+        timer_add(&copy.w, 1, TIMER_HOLE_FILL, i, 0);
+    }
+    if (copy.w.free != TIMER_NONE) {
+        die("timers are lost");
+    }
+
+    printf("timer: %ld added, %ld cancelled\n", added, cancelled);
+
+    return 0;
+}